@@ -0,0 +1,405 @@
+/*
+ * \brief  Catalogue of chargen configurations of many layouts
+ * \author Christian Helmuth <christian.helmuth@genode-labs.com>
+ * \date   2026-10-18
+ *
+ * Copyright (C) 2026 Genode Labs GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Linux includes */
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include "xkb2ifcfg.h"
+#include "chargen.h"
+#include "bundle.h"
+#include "xml_buffer.h"
+#include "util.h"
+
+using Xkb2ifcfg::Sink;
+using Xkb2ifcfg::Bundle;
+using namespace Bundle_format;
+
+
+struct Bundle::Layouts
+{
+	struct Layout
+	{
+		std::string name;
+		Chargen     chargen;
+		size_t      config_size;
+	};
+
+	std::vector<Layout> list { };
+};
+
+
+/*
+ * Builder of the archive (see bundle.h)
+ */
+class Archive
+{
+	private:
+
+		using Layout = Bundle::Layouts::Layout;
+
+		std::vector<Layout> const &_layouts;
+
+		/* map slots are keys-less maps, the sequence slot has SEQUENCES as mods */
+		std::vector<Chargen::Map>    _slots      { };
+		std::vector<uint32_t>        _codepoints { 0 };
+		std::map<uint32_t, uint16_t> _index      { };
+		std::vector<uint16_t>        _entries    { };
+		std::vector<Range>           _bases      { };
+		std::vector<Range>           _overlays   { };  /* [layout][slot] */
+
+		/* identical tables are stored once */
+		std::map<std::vector<uint16_t>, Range> _tables { };
+
+		void _add_codepoint(uint32_t c) { if (c) _codepoints.push_back(c); }
+
+		void _collect_codepoints()
+		{
+			for (Layout const &l : _layouts) {
+				for (Chargen::Map const &m : l.chargen.maps)
+					for (Chargen::Key const &k : m.keys) _add_codepoint(k.value);
+
+				for (Chargen::Sequence const &s : l.chargen.sequences) {
+					for (unsigned c : s.seq) _add_codepoint(c);
+					_add_codepoint(s.code);
+				}
+			}
+
+			std::sort(_codepoints.begin(), _codepoints.end());
+			_codepoints.erase(std::unique(_codepoints.begin(), _codepoints.end()),
+			                  _codepoints.end());
+
+			if (_codepoints.size() >= REMOVED) throw Bundle::Too_large();
+
+			for (unsigned i = 0; i < _codepoints.size(); ++i)
+				_index[_codepoints[i]] = uint16_t(i);
+		}
+
+		void _encode(std::vector<uint16_t> &out, Chargen::Key const &k, bool removed = false)
+		{
+			out.push_back(uint16_t(k.code | (k.ascii ? ASCII : 0)));
+			out.push_back(removed ? uint16_t(REMOVED) : _index.at(k.value));
+		}
+
+		void _encode(std::vector<uint16_t> &out, Chargen::Sequence const &s, bool removed = false)
+		{
+			for (unsigned c : s.seq) out.push_back(_index.at(c));
+			out.push_back(removed ? uint16_t(REMOVED) : _index.at(s.code));
+		}
+
+		Range _table(std::vector<uint16_t> const &entries, unsigned entry)
+		{
+			if (entries.empty()) return Range { 0, 0 };
+
+			auto const it = _tables.find(entries);
+			if (it != _tables.end()) {
+				++shared_tables;
+				return it->second;
+			}
+
+			Range const range { uint32_t(_entries.size()), uint32_t(entries.size() / entry) };
+			_entries.insert(_entries.end(), entries.begin(), entries.end());
+			_tables[entries] = range;
+
+			return range;
+		}
+
+		/*
+		 * Entries of 'table' that differ from 'base'
+		 */
+		template <typename T, typename SAME_KEY>
+		std::vector<uint16_t> _overlay(std::vector<T> const &base, std::vector<T> const &table,
+		                               SAME_KEY const &same_key)
+		{
+			std::vector<uint16_t> result;
+
+			Chargen::_for_each_change(base, table, same_key, [&] (T const &e, bool removed) {
+				_encode(result, e, removed); });
+
+			return result;
+		}
+
+		/*
+		 * Build base and overlays of slot from the tables of the layouts
+		 * (nullptr if the layout has no table in the slot)
+		 */
+		template <typename T, typename SAME_KEY>
+		void _build_slot(std::vector<std::vector<T> const *> const &tables,
+		                 unsigned entry, SAME_KEY const &same_key)
+		{
+			/* most common table is the base */
+			std::vector<T> const *base  = nullptr;
+			unsigned              count = 0;
+			for (auto const *t : tables) {
+				if (!t) continue;
+				unsigned const n = unsigned(std::count_if(tables.begin(), tables.end(),
+					[&] (std::vector<T> const *o) { return o && *o == *t; }));
+				if (n > count) { base = t; count = n; }
+			}
+
+			std::vector<uint16_t> base_entries;
+			for (T const &e : *base) _encode(base_entries, e);
+
+			_bases.push_back(_table(base_entries, entry));
+			base_entries_count += base->size();
+
+			for (auto const *t : tables) {
+				if (!t) {
+					_overlays.push_back(Range { ABSENT, 0 });
+					continue;
+				}
+				std::vector<uint16_t> const overlay = _overlay(*base, *t, same_key);
+				_overlays.push_back(_table(overlay, entry));
+				overlay_entries += overlay.size() / entry;
+				++overlay_tables;
+			}
+		}
+
+	public:
+
+		unsigned long base_entries_count { 0 };
+		unsigned long overlay_entries    { 0 };
+		unsigned long overlay_tables     { 0 };
+		unsigned long shared_tables      { 0 };
+
+		std::string data { };
+
+		Archive(std::vector<Layout> const &layouts) : _layouts(layouts)
+		{
+			_collect_codepoints();
+
+			for (Layout const &l : _layouts)
+				for (Chargen::Map const &m : l.chargen.maps)
+					_slots.push_back(Chargen::Map { m.mods, m.specified, { } });
+
+			std::sort(_slots.begin(), _slots.end());
+			_slots.erase(std::unique(_slots.begin(), _slots.end()), _slots.end());
+			_slots.push_back(Chargen::Map { SEQUENCES, 0, { } });
+
+			for (Chargen::Map const &s : _slots) {
+				if (s.mods == SEQUENCES) {
+					std::vector<std::vector<Chargen::Sequence> const *> tables;
+					for (Layout const &l : _layouts)
+						tables.push_back(&l.chargen.sequences);
+
+					_build_slot(tables, SEQUENCE_ENTRY, Chargen::_same_keys);
+				} else {
+					std::vector<std::vector<Chargen::Key> const *> tables;
+					for (Layout const &l : _layouts) {
+						Chargen::Map const *m = l.chargen.map(s);
+						tables.push_back(m ? &m->keys : nullptr);
+					}
+
+					_build_slot(tables, KEY_ENTRY, Chargen::_same_code);
+				}
+			}
+
+			/* serialize */
+			std::string strings;
+			std::vector<uint32_t> names;
+			for (Layout const &l : _layouts) {
+				names.push_back(uint32_t(strings.size()));
+				strings.append(l.name.c_str(), l.name.size() + 1);
+			}
+
+			auto align = [] (size_t v) { return uint32_t((v + 3) & ~3ul); };
+
+			Header h { };
+			h.magic          = MAGIC;
+			h.version        = VERSION;
+			h.num_layouts    = uint32_t(_layouts.size());
+			h.num_slots      = uint32_t(_slots.size());
+			h.num_codepoints = uint32_t(_codepoints.size());
+			h.num_entries    = uint32_t(_entries.size());
+			h.strings_size   = uint32_t(strings.size());
+			h.slots          = align(sizeof(Header));
+			h.names          = h.slots      + h.num_slots * sizeof(Slot);
+			h.overlays       = h.names      + h.num_layouts * sizeof(uint32_t);
+			h.codepoints     = h.overlays   + h.num_layouts * h.num_slots * sizeof(Range);
+			h.entries        = h.codepoints + h.num_codepoints * sizeof(uint32_t);
+			h.strings        = align(h.entries + h.num_entries * sizeof(uint16_t));
+			h.size           = align(h.strings + h.strings_size);
+
+			data.assign(h.size, 0);
+
+			auto put = [&] (uint32_t offset, void const *src, size_t len) {
+				if (len) ::memcpy(&data[offset], src, len); };
+
+			std::vector<Slot> slot_records;
+			for (unsigned i = 0; i < _slots.size(); ++i)
+				slot_records.push_back(Slot { _slots[i].mods, _slots[i].specified,
+				                              _bases[i] });
+
+			/* overlays were built per slot but are stored per layout */
+			std::vector<Range> overlays(_overlays.size());
+			for (unsigned s = 0; s < h.num_slots; ++s)
+				for (unsigned l = 0; l < h.num_layouts; ++l)
+					overlays[l*h.num_slots + s] = _overlays[s*h.num_layouts + l];
+
+			put(0,            &h,                   sizeof(h));
+			put(h.slots,      slot_records.data(),  slot_records.size() * sizeof(Slot));
+			put(h.names,      names.data(),         names.size() * sizeof(uint32_t));
+			put(h.overlays,   overlays.data(),      overlays.size() * sizeof(Range));
+			put(h.codepoints, _codepoints.data(),   _codepoints.size() * sizeof(uint32_t));
+			put(h.entries,    _entries.data(),      _entries.size() * sizeof(uint16_t));
+			put(h.strings,    strings.data(),       strings.size());
+		}
+
+		size_t num_slots()      const { return _slots.size(); }
+		size_t num_codepoints() const { return _codepoints.size(); }
+		size_t num_entries()    const { return _entries.size(); }
+};
+
+
+/*
+ * Reconstruct chargen of layout from archive
+ */
+static Chargen chargen(Bundle_reader const &reader, unsigned layout)
+{
+	Chargen result;
+
+	for (unsigned s = 0; s < reader.num_slots(); ++s) {
+		if (!reader.present(layout, s) || reader.slot_mods(s) == SEQUENCES) continue;
+
+		Chargen::Map map;
+		map.mods      = reader.slot_mods(s);
+		map.specified = reader.slot_specified(s);
+		reader.for_each_key(layout, s, [&] (unsigned code, uint32_t value, bool ascii) {
+			map.keys.push_back(Chargen::Key { code, value, ascii }); });
+
+		result.maps.push_back(map);
+	}
+
+	reader.for_each_sequence(layout, [&] (uint32_t const seq[4], uint32_t code) {
+		Chargen::Sequence s;
+		for (unsigned i = 0; i < Chargen::Sequence::MAX_LENGTH; ++i) s.seq[i] = seq[i];
+		s.code = code;
+		result.sequences.push_back(s);
+	});
+
+	return result;
+}
+
+
+Bundle::Bundle(Sink &diag) : _diag(diag), _layouts(new Layouts) { }
+
+
+Bundle::~Bundle() { delete _layouts; }
+
+
+int Bundle::add(Config const &config)
+{
+	String_sink output;
+
+	int const result = Generator(config, output, _diag).generate();
+
+	_layouts->list.push_back({
+		Formatted("%s/%s/%s", config.layout, config.variant, config.locale).string(),
+		Chargen(output.data.c_str(), output.data.size()),
+		output.data.size() });
+
+	return result;
+}
+
+
+void Bundle::add(char const *name, char const *config)
+{
+	try {
+		_layouts->list.push_back({ name, Chargen(config, strlen(config)),
+		                           strlen(config) });
+	} catch (Chargen::Invalid_config) { throw Xkb2ifcfg::Invalid_config(); }
+}
+
+
+int Bundle::write(Sink &output)
+{
+	Archive const archive(_layouts->list);
+
+	/* check that the archive reproduces the configs */
+	int result = 0;
+	Bundle_reader const reader(archive.data.data(), archive.data.size());
+	for (unsigned l = 0; l < _layouts->list.size(); ++l) {
+		if (chargen(reader, l) == _layouts->list[l].chargen) continue;
+
+		_diag.printf("bundle: archive does not reproduce %s\n", reader.layout_name(l));
+		result = 1;
+	}
+
+	output.write(archive.data.data(), archive.data.size());
+
+	size_t configs_size = 0;
+	for (Layouts::Layout const &l : _layouts->list) configs_size += l.config_size;
+
+	_diag.printf("bundle: %zu layouts in %zu slots (maps and sequences)\n",
+	             _layouts->list.size(), archive.num_slots());
+	_diag.printf("  base tables:  %lu entries\n", archive.base_entries_count);
+	_diag.printf("  overlays:     %lu entries, %lu of %lu tables shared\n",
+	             archive.overlay_entries, archive.shared_tables,
+	             archive.overlay_tables + archive.num_slots());
+	_diag.printf("  codepoints:   %zu (%zu bytes of %zu bytes entries)\n",
+	             archive.num_codepoints(), archive.num_codepoints() * sizeof(uint32_t),
+	             archive.num_entries() * sizeof(uint16_t));
+	_diag.printf("  archive:      %zu bytes, individual configs %zu bytes (%.1f%%)\n",
+	             archive.data.size(), configs_size,
+	             configs_size ? 100.0 * archive.data.size() / configs_size : 0.0);
+
+	return result;
+}
+
+
+int Bundle::extract(void const *data, size_t size, char const *layout,
+                    Sink &output, Sink &diag)
+{
+	try {
+		Bundle_reader const reader(data, size);
+
+		if (!layout) {
+			for (unsigned l = 0; l < reader.num_layouts(); ++l)
+				output.printf("%s\n", reader.layout_name(l));
+			return 0;
+		}
+
+		int const l = reader.layout(layout);
+		if (l < 0) {
+			diag.printf("extract: layout %s not in archive\n", layout);
+			return 1;
+		}
+
+		Chargen const result = chargen(reader, unsigned(l));
+
+		Expanding_xml_buffer xml_buffer;
+		xml_buffer.generate("chargen", [&] (Genode::Xml_generator &xml) {
+			result.generate(xml); });
+
+		output.write(xml_buffer.buffer(), strlen(xml_buffer.buffer()));
+		output.write("\n", 1);
+
+		return 0;
+	} catch (Bundle_reader::Invalid_bundle) { throw Bundle::Invalid_bundle(); }
+}
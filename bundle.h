@@ -0,0 +1,280 @@
+/*
+ * \brief  Catalogue of chargen configurations of many layouts
+ * \author Christian Helmuth <christian.helmuth@genode-labs.com>
+ * \date   2026-10-18
+ *
+ * Copyright (C) 2026 Genode Labs GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BUNDLE_H_
+#define _BUNDLE_H_
+
+/* Linux includes */
+#include <cstdint>
+#include <cstring>
+
+
+/*
+ * Archive format
+ *
+ * The archive is position independent (all references are byte offsets
+ * from the start) and naturally aligned, so it can be used in place from
+ * an mmapped file. The tables of all layouts are organized in slots: one
+ * per map (modifiers) and one for the dead-key / compose
+ * sequences. Each slot has a base table (the most common content among
+ * the layouts) and each layout has an overlay of its differences to the
+ * base. Entries reference characters by index into a sorted codepoint
+ * pool. Identical tables are stored once.
+ *
+ *   Header
+ *   Slot     slots[num_slots]
+ *   uint32_t names[num_layouts]               offsets into string pool
+ *   Range    overlays[num_layouts][num_slots]
+ *   uint32_t codepoints[num_codepoints]       sorted, codepoints[0] = 0
+ *   uint16_t entries[]
+ *   char     strings[]
+ *
+ * Key entries are two uint16_t values: key code (ASCII flag for 'ascii'
+ * keys) and codepoint index. Sequence entries are five indices: first to
+ * fourth (index 0 if unused) and code. Entries of a table are ordered by
+ * key code resp. sequence. In overlays, entries replace or add to the
+ * base table; entries with the REMOVED index remove the base entry.
+ */
+namespace Bundle_format {
+
+	enum : uint32_t {
+		MAGIC     = 0x32424b58,   /* "XKB2" */
+		VERSION   = 3,            /* 3: slots without group */
+		SEQUENCES = ~0u,          /* modifiers of the sequence slot */
+		ABSENT    = ~0u,          /* range offset of absent tables */
+	};
+
+	enum : uint16_t {
+		ASCII   = 0x8000,         /* flag in key code */
+		REMOVED = 0xffff,         /* codepoint index of removed entries */
+	};
+
+	enum { KEY_ENTRY = 2, SEQUENCE_ENTRY = 5 }; /* uint16_t values per entry */
+
+	struct Range
+	{
+		uint32_t offset;          /* index into entries */
+		uint32_t count;           /* number of entries */
+	};
+
+	struct Slot
+	{
+		uint32_t mods;            /* bit mask of Xkb::modifier or SEQUENCES */
+		uint32_t specified;       /* modifiers with attribute in map */
+		Range    base;
+	};
+
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t size;            /* of the whole archive */
+		uint32_t num_layouts;
+		uint32_t num_slots;
+		uint32_t num_codepoints;
+		uint32_t num_entries;     /* uint16_t values */
+		uint32_t strings_size;
+		uint32_t slots;           /* offsets of the sections */
+		uint32_t names;
+		uint32_t overlays;
+		uint32_t codepoints;
+		uint32_t entries;
+		uint32_t strings;
+	};
+}
+
+
+/*
+ * Read-only access to an archive in memory
+ */
+class Bundle_reader
+{
+	public:
+
+		struct Invalid_bundle { };
+
+	private:
+
+		char const             *_base;
+		Bundle_format::Header   _header;
+
+		template <typename T>
+		T const * _at(uint32_t offset) const { return (T const *)(_base + offset); }
+
+		Bundle_format::Slot const & _slot(unsigned slot) const {
+			return _at<Bundle_format::Slot>(_header.slots)[slot]; }
+
+		Bundle_format::Range const & _overlay(unsigned layout, unsigned slot) const {
+			return _at<Bundle_format::Range>(_header.overlays)[layout*_header.num_slots + slot]; }
+
+		uint16_t const * _entry(uint32_t index) const {
+			return _at<uint16_t>(_header.entries) + index; }
+
+		uint32_t _codepoint(uint16_t index) const {
+			return _at<uint32_t>(_header.codepoints)[index]; }
+
+		static int _compare(uint16_t const *a, uint16_t const *b, unsigned entry)
+		{
+			/* keys compare by key code, sequences by first to fourth */
+			unsigned const n = entry == Bundle_format::KEY_ENTRY ? 1 : entry - 1;
+			for (unsigned i = 0; i < n; ++i) {
+				uint16_t const x = entry == Bundle_format::KEY_ENTRY ? a[i] & ~Bundle_format::ASCII : a[i];
+				uint16_t const y = entry == Bundle_format::KEY_ENTRY ? b[i] & ~Bundle_format::ASCII : b[i];
+				if (x != y) return x < y ? -1 : 1;
+			}
+			return 0;
+		}
+
+		/*
+		 * Merge base table and overlay of slot in order of entries
+		 */
+		template <typename FN>
+		void _for_each_entry(unsigned layout, unsigned slot, unsigned entry, FN const &fn) const
+		{
+			Bundle_format::Range const base    = _slot(slot).base;
+			Bundle_format::Range const overlay = _overlay(layout, slot);
+			if (overlay.offset == Bundle_format::ABSENT) return;
+
+			uint32_t b = 0, o = 0;
+			while (b < base.count || o < overlay.count) {
+				uint16_t const *be = b < base.count    ? _entry(base.offset    + b*entry) : nullptr;
+				uint16_t const *oe = o < overlay.count ? _entry(overlay.offset + o*entry) : nullptr;
+
+				int const cmp = !be ? 1 : !oe ? -1 : _compare(be, oe, entry);
+
+				if (cmp < 0) { fn(be); ++b; continue; }
+				if (cmp == 0) ++b;
+
+				if (oe[entry - 1] != Bundle_format::REMOVED) fn(oe);
+				++o;
+			}
+		}
+
+	public:
+
+		/*
+		 * Constructor
+		 *
+		 * \throw Invalid_bundle
+		 */
+		Bundle_reader(void const *data, size_t size) : _base((char const *)data)
+		{
+			using namespace Bundle_format;
+
+			if (size < sizeof(Header)) throw Invalid_bundle();
+			::memcpy(&_header, data, sizeof(Header));
+
+			Header const &h = _header;
+
+			auto within = [&] (uint32_t offset, uint64_t len) {
+				return offset % 4 == 0 && offset + len <= size; };
+
+			if (h.magic != MAGIC || h.version != VERSION || h.size != size
+			 || !within(h.slots,      uint64_t(h.num_slots) * sizeof(Slot))
+			 || !within(h.names,      uint64_t(h.num_layouts) * sizeof(uint32_t))
+			 || !within(h.overlays,   uint64_t(h.num_layouts) * h.num_slots * sizeof(Range))
+			 || !within(h.codepoints, uint64_t(h.num_codepoints) * sizeof(uint32_t))
+			 || !within(h.entries,    uint64_t(h.num_entries) * sizeof(uint16_t))
+			 || h.strings + uint64_t(h.strings_size) > size
+			 || !h.strings_size || _base[h.strings + h.strings_size - 1] != 0)
+				throw Invalid_bundle();
+
+			auto valid = [&] (Range r, unsigned entry)
+			{
+				if (r.offset == ABSENT) return true;
+				if (r.offset + uint64_t(r.count) * entry > h.num_entries) return false;
+
+				/* codepoint indices (the key code of key entries excluded) */
+				for (uint32_t i = 0; i < r.count; ++i) {
+					uint16_t const *e = _entry(r.offset + i*entry);
+					for (unsigned j = entry == KEY_ENTRY ? 1 : 0; j < entry; ++j)
+						if (e[j] >= h.num_codepoints && e[j] != REMOVED) return false;
+				}
+				return true;
+			};
+
+			for (unsigned s = 0; s < h.num_slots; ++s) {
+				unsigned const entry = _slot(s).mods == SEQUENCES ? SEQUENCE_ENTRY : KEY_ENTRY;
+				if (!valid(_slot(s).base, entry)) throw Invalid_bundle();
+				for (unsigned l = 0; l < h.num_layouts; ++l)
+					if (!valid(_overlay(l, s), entry)) throw Invalid_bundle();
+			}
+
+			for (unsigned l = 0; l < h.num_layouts; ++l)
+				if (_at<uint32_t>(h.names)[l] >= h.strings_size) throw Invalid_bundle();
+		}
+
+		unsigned num_layouts() const { return _header.num_layouts; }
+		unsigned num_slots()   const { return _header.num_slots; }
+
+		char const * layout_name(unsigned layout) const {
+			return _at<char>(_header.strings) + _at<uint32_t>(_header.names)[layout]; }
+
+		/*
+		 * Return index of layout or -1 if not found
+		 */
+		int layout(char const *name) const
+		{
+			for (unsigned l = 0; l < num_layouts(); ++l)
+				if (!::strcmp(layout_name(l), name)) return l;
+			return -1;
+		}
+
+		unsigned slot_mods(unsigned slot)      const { return _slot(slot).mods; }
+		unsigned slot_specified(unsigned slot) const { return _slot(slot).specified; }
+
+		bool present(unsigned layout, unsigned slot) const {
+			return _overlay(layout, slot).offset != Bundle_format::ABSENT; }
+
+		/*
+		 * Call 'fn(code, value, ascii)' for each key of map slot
+		 */
+		template <typename FN>
+		void for_each_key(unsigned layout, unsigned slot, FN const &fn) const
+		{
+			_for_each_entry(layout, slot, Bundle_format::KEY_ENTRY, [&] (uint16_t const *e) {
+				fn(unsigned(e[0] & ~Bundle_format::ASCII), _codepoint(e[1]),
+				   bool(e[0] & Bundle_format::ASCII)); });
+		}
+
+		/*
+		 * Call 'fn(seq, code)' for each sequence with 'uint32_t seq[4]'
+		 */
+		template <typename FN>
+		void for_each_sequence(unsigned layout, FN const &fn) const
+		{
+			for (unsigned s = 0; s < num_slots(); ++s) {
+				if (_slot(s).mods != Bundle_format::SEQUENCES) continue;
+
+				_for_each_entry(layout, s, Bundle_format::SEQUENCE_ENTRY, [&] (uint16_t const *e) {
+					uint32_t const seq[4] { _codepoint(e[0]), _codepoint(e[1]),
+					                        _codepoint(e[2]), _codepoint(e[3]) };
+					fn(seq, _codepoint(e[4])); });
+			}
+		}
+};
+
+#endif /* _BUNDLE_H_ */
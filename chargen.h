@@ -0,0 +1,438 @@
+/*
+ * \brief  Tables of chargen configurations
+ * \author Christian Helmuth <christian.helmuth@genode-labs.com>
+ * \date   2026-10-18
+ *
+ * Copyright (C) 2026 Genode Labs GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _CHARGEN_H_
+#define _CHARGEN_H_
+
+/* Linux includes */
+#include <cstring>
+#include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+
+/* Genode includes */
+#include <util/xml_node.h>
+#include <util/xml_generator.h>
+#include <input/keycodes.h>
+
+#include "xkb_mapping.h"
+#include "util.h"
+
+
+/*
+ * Content of a chargen configuration as seen by input_filter
+ *
+ * The tables are independent of the formatting, comments, and order of
+ * maps, keys, and sequences in the XML config and are used to compare,
+ * store, and update configs. Duplicate entries (e.g., sequences of '+'
+ * on the main and the keypad row) are reduced to the first one.
+ *
+ * Delta documents (<chargen_delta>) contain the maps and sequences that
+ * changed between two configs. Maps are identified by their attributes,
+ * keys by name, and sequences by first to fourth. Keys and sequences
+ * without value remove the entry, maps with remove="yes" the whole map.
+ */
+struct Chargen
+{
+	struct Invalid_config { };
+
+	struct Key
+	{
+		unsigned code  { 0 };     /* Input::Keycode */
+		unsigned value { 0 };     /* UTF-32 or ASCII */
+		bool     ascii { false };
+
+		bool operator == (Key const &o) const
+		{
+			return code == o.code && value == o.value && ascii == o.ascii;
+		}
+
+		bool operator < (Key const &o) const { return code < o.code; }
+	};
+
+	struct Map
+	{
+		unsigned mods      { 0 }; /* bit mask of Xkb::modifier */
+		unsigned specified { 0 }; /* modifiers with attribute (others don't care) */
+
+		std::vector<Key> keys { }; /* ordered by key code */
+
+		bool same_slot(Map const &o) const
+		{
+			return mods == o.mods && specified == o.specified;
+		}
+
+		bool operator == (Map const &o) const { return same_slot(o) && keys == o.keys; }
+
+		bool operator < (Map const &o) const
+		{
+			return mods != o.mods ? mods < o.mods : specified < o.specified;
+		}
+
+		Key const * key(unsigned code) const
+		{
+			auto const it = std::lower_bound(keys.begin(), keys.end(), Key { code, 0, false });
+			return it != keys.end() && it->code == code ? &*it : nullptr;
+		}
+	};
+
+	struct Sequence
+	{
+		enum { MAX_LENGTH = 4 };
+
+		unsigned seq[MAX_LENGTH] { };  /* first .. fourth (0 if unused) */
+		unsigned code            { 0 };
+
+		bool operator == (Sequence const &o) const
+		{
+			return !::memcmp(seq, o.seq, sizeof(seq)) && code == o.code;
+		}
+
+		bool operator < (Sequence const &o) const
+		{
+			return std::lexicographical_compare(seq, seq + MAX_LENGTH,
+			                                    o.seq, o.seq + MAX_LENGTH);
+		}
+
+		bool same_keys(Sequence const &o) const { return !::memcmp(seq, o.seq, sizeof(seq)); }
+	};
+
+	std::vector<Map>      maps      { };  /* ordered by modifiers */
+	std::vector<Sequence> sequences { };  /* ordered by keys */
+
+	/*
+	 * Order entries and drop all but the first entry with the same key
+	 */
+	template <typename T, typename SAME_KEY>
+	static void _normalize(std::vector<T> &entries, SAME_KEY const &same_key)
+	{
+		std::stable_sort(entries.begin(), entries.end());
+		entries.erase(std::unique(entries.begin(), entries.end(), same_key), entries.end());
+	}
+
+	static bool _same_code(Key const &a, Key const &b) { return a.code == b.code; }
+
+	static bool _same_keys(Sequence const &a, Sequence const &b) { return a.same_keys(b); }
+
+	static bool _same_slot(Map const &a, Map const &b) { return a.same_slot(b); }
+
+	bool operator == (Chargen const &o) const
+	{
+		return maps == o.maps && sequences == o.sequences;
+	}
+
+	bool operator != (Chargen const &o) const { return !(*this == o); }
+
+	Map const * map(Map const &slot) const
+	{
+		for (Map const &m : maps)
+			if (m.same_slot(slot)) return &m;
+		return nullptr;
+	}
+
+	static unsigned _keycode(char const *name)
+	{
+		static std::map<std::string, unsigned> const codes = [] () {
+			std::map<std::string, unsigned> result;
+			for (unsigned i = 0; i <= Input::KEY_MAX; ++i)
+				result[Input::key_name(Input::Keycode(i))] = i;
+			return result;
+		} ();
+
+		auto const it = codes.find(name);
+		if (it == codes.end()) throw Invalid_config();
+
+		return it->second;
+	}
+
+	enum { NUM_MODIFIERS = sizeof(Xkb::modifier)/sizeof(Xkb::modifier[0]) };
+
+	/*
+	 * Map without keys
+	 */
+	static Map _map_slot(Genode::Xml_node node)
+	{
+		Map map;
+
+		for (unsigned i = 0; i < NUM_MODIFIERS; ++i) {
+			if (!node.has_attribute(Xkb::modifier[i].attr)) continue;
+
+			map.specified |= 1u << i;
+			if (node.attribute_value(Xkb::modifier[i].attr, false))
+				map.mods |= 1u << i;
+		}
+		return map;
+	}
+
+	/*
+	 * Key of key node (value 0 if the node has no value)
+	 */
+	static Key _key(Genode::Xml_node node)
+	{
+		using Name = Genode::String<64>;
+
+		Key k;
+		k.code  = _keycode(node.attribute_value("name", Name()).string());
+		k.ascii = node.has_attribute("ascii");
+		k.value = k.ascii ? node.attribute_value("ascii", 0u)
+		                  : node.attribute_value("code",  0u);
+		return k;
+	}
+
+	static Map _map(Genode::Xml_node node)
+	{
+		Map map = _map_slot(node);
+
+		node.for_each_sub_node("key", [&] (Genode::Xml_node key) {
+			map.keys.push_back(_key(key)); });
+
+		_normalize(map.keys, _same_code);
+
+		return map;
+	}
+
+	static Sequence _sequence(Genode::Xml_node node)
+	{
+		static char const *attr[Sequence::MAX_LENGTH] {
+			"first", "second", "third", "fourth" };
+
+		Sequence s;
+		for (unsigned i = 0; i < Sequence::MAX_LENGTH; ++i)
+			s.seq[i] = node.attribute_value(attr[i], 0u);
+		s.code = node.attribute_value("code", 0u);
+
+		return s;
+	}
+
+	static bool _has_value(Genode::Xml_node node)
+	{
+		return node.has_attribute("code") || node.has_attribute("ascii");
+	}
+
+	static void _map_attributes(Genode::Xml_generator &xml, Map const &m)
+	{
+		for (unsigned i = 0; i < NUM_MODIFIERS; ++i)
+			if (m.specified & (1u << i))
+				xml.attribute(Xkb::modifier[i].attr, bool(m.mods & (1u << i)));
+	}
+
+	static void _key_node(Genode::Xml_generator &xml, Key const &k, bool removed = false)
+	{
+		xml.node("key", [&] () {
+			xml.attribute("name", Input::key_name(Input::Keycode(k.code)));
+			if (removed) return;
+
+			if (k.ascii) xml.attribute("ascii", k.value);
+			else         xml.attribute("code",  Formatted("0x%04x", k.value).string());
+		});
+	}
+
+	static void _sequence_node(Genode::Xml_generator &xml, Sequence const &s,
+	                           bool removed = false)
+	{
+		static char const *attr[Sequence::MAX_LENGTH] {
+			"first", "second", "third", "fourth" };
+
+		xml.node("sequence", [&] () {
+			for (unsigned i = 0; i < Sequence::MAX_LENGTH && s.seq[i]; ++i)
+				xml.attribute(attr[i], Formatted("0x%04x", s.seq[i]).string());
+
+			if (!removed)
+				xml.attribute("code", Formatted("0x%04x", s.code).string());
+		});
+	}
+
+	/*
+	 * Call 'fn(entry, removed)' for each entry of 'to' that differs from
+	 * 'from' and each entry of 'from' missing in 'to' (both ordered)
+	 */
+	template <typename T, typename SAME_KEY, typename FN>
+	static void _for_each_change(std::vector<T> const &from, std::vector<T> const &to,
+	                             SAME_KEY const &same_key, FN const &fn)
+	{
+		auto f = from.begin();
+		auto t = to.begin();
+		while (f != from.end() || t != to.end()) {
+			if (t == to.end() || (f != from.end() && *f < *t && !same_key(*f, *t))) {
+				fn(*f++, true);
+			} else if (f == from.end() || !same_key(*f, *t)) {
+				fn(*t++, false);
+			} else {
+				if (!(*f == *t)) fn(*t, false);
+				++f; ++t;
+			}
+		}
+	}
+
+	Chargen() { }
+
+	/*
+	 * Generate config from tables (without comments)
+	 */
+	void generate(Genode::Xml_generator &xml) const
+	{
+		for (Map const &m : maps)
+			xml.node("map", [&] () {
+				_map_attributes(xml, m);
+				for (Key const &k : m.keys) _key_node(xml, k);
+			});
+
+		for (Sequence const &s : sequences) _sequence_node(xml, s);
+	}
+
+	/*
+	 * Generate delta document that turns 'from' into 'to'
+	 *
+	 * \return number of changed entries
+	 */
+	static unsigned long generate_delta(Genode::Xml_generator &xml,
+	                                    Chargen const &from, Chargen const &to)
+	{
+		unsigned long changes = 0;
+
+		for (Map const &m : from.maps) {
+			if (to.map(m)) continue;
+
+			xml.node("map", [&] () {
+				_map_attributes(xml, m);
+				xml.attribute("remove", true);
+			});
+			++changes;
+		}
+
+		static std::vector<Key> const no_keys { };
+
+		for (Map const &m : to.maps) {
+			Map const *old = from.map(m);
+
+			std::vector<std::pair<Key, bool>> keys;
+			_for_each_change(old ? old->keys : no_keys, m.keys, _same_code,
+			                 [&] (Key const &k, bool removed) { keys.push_back({ k, removed }); });
+
+			if (old && keys.empty()) continue;
+
+			xml.node("map", [&] () {
+				_map_attributes(xml, m);
+				for (auto const &k : keys) _key_node(xml, k.first, k.second);
+			});
+			changes += keys.size() + (old ? 0 : 1);
+		}
+
+		_for_each_change(from.sequences, to.sequences, _same_keys,
+		                 [&] (Sequence const &s, bool removed) {
+		                 	_sequence_node(xml, s, removed);
+		                 	++changes; });
+
+		return changes;
+	}
+
+	/*
+	 * Apply delta document
+	 *
+	 * \throw Invalid_config
+	 */
+	void apply_delta(char const *xml, size_t len)
+	{
+		char const *start = (char const *)::memmem(xml, len, "<chargen_delta", 14);
+		if (!start) throw Invalid_config();
+
+		try {
+			Genode::Xml_node const node(start, len - (start - xml));
+			if (!node.has_type("chargen_delta")) throw Invalid_config();
+
+			node.for_each_sub_node("map", [&] (Genode::Xml_node delta) {
+				Map const slot = _map_slot(delta);
+
+				auto map = std::find_if(maps.begin(), maps.end(),
+				                        [&] (Map const &m) { return m.same_slot(slot); });
+
+				if (delta.attribute_value("remove", false)) {
+					if (map != maps.end()) maps.erase(map);
+					return;
+				}
+
+				if (map == maps.end()) {
+					maps.push_back(slot);
+					map = maps.end() - 1;
+				}
+
+				std::vector<Key> &keys = map->keys;
+				delta.for_each_sub_node("key", [&] (Genode::Xml_node node) {
+					Key const k = _key(node);
+
+					keys.erase(std::remove_if(keys.begin(), keys.end(),
+					                          [&] (Key const &o) { return o.code == k.code; }),
+					           keys.end());
+					if (_has_value(node)) keys.push_back(k);
+				});
+				_normalize(keys, _same_code);
+			});
+
+			node.for_each_sub_node("sequence", [&] (Genode::Xml_node node) {
+				Sequence const s = _sequence(node);
+
+				sequences.erase(std::remove_if(sequences.begin(), sequences.end(),
+				                               [&] (Sequence const &o) { return o.same_keys(s); }),
+				                sequences.end());
+				if (node.has_attribute("code")) sequences.push_back(s);
+			});
+		} catch (Genode::Xml_node::Invalid_syntax) { throw Invalid_config(); }
+
+		_normalize(maps,      _same_slot);
+		_normalize(sequences, _same_keys);
+	}
+
+	/*
+	 * Constructor
+	 *
+	 * \param xml  chargen config, may be preceded by comments
+	 *
+	 * \throw Invalid_config
+	 */
+	Chargen(char const *xml, size_t len)
+	{
+		char const *start = (char const *)::memmem(xml, len, "<chargen", 8);
+		if (!start) throw Invalid_config();
+
+		try {
+			/* "<chargen" also matches the start of "<chargen_delta" */
+			Genode::Xml_node const node(start, len - (start - xml));
+			if (!node.has_type("chargen")) throw Invalid_config();
+
+			node.for_each_sub_node("map", [&] (Genode::Xml_node map) {
+				maps.push_back(_map(map)); });
+
+			node.for_each_sub_node("sequence", [&] (Genode::Xml_node sequence) {
+				sequences.push_back(_sequence(sequence)); });
+		} catch (Genode::Xml_node::Invalid_syntax) { throw Invalid_config(); }
+
+		_normalize(maps,      _same_slot);
+		_normalize(sequences, _same_keys);
+	}
+};
+
+#endif /* _CHARGEN_H_ */
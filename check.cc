@@ -0,0 +1,384 @@
+/*
+ * \brief  Checks of config formats that need no XKB keymaps
+ * \author Christian Helmuth <christian.helmuth@genode-labs.com>
+ * \date   2026-10-18
+ *
+ * Copyright (C) 2026 Genode Labs GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Linux includes */
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "xkb2ifcfg.h"
+#include "xkb_mapping.h"
+#include "chargen.h"
+#include "config_text.h"
+#include "xml_buffer.h"
+#include "util.h"
+
+using Xkb2ifcfg::Bundle;
+using Xkb2ifcfg::Generator;
+
+
+/*
+ * Annotated configs in the format of the generator
+ */
+static char const *config_a =
+	"<chargen>\n"
+	"\t<map>\n"
+	"\t\t<!-- printable -->\n"
+	"\t\t<key name=\"KEY_A\" code=\"0x0061\"/>\t<!-- a -->\n"
+	"\t\t<key name=\"KEY_B\" code=\"0x0062\"/>\t<!-- b -->\n"
+	"\n"
+	"\t\t<!-- non-printable -->\n"
+	"\t\t<key name=\"KEY_ESC\" ascii=\"27\"/>\n"
+	"\t\t<dummy/>\n"
+	"\t</map>\n"
+	"\n"
+	"\t<!-- SHIFT -->\n"
+	"\t<map mod1=\"yes\" mod2=\"no\" mod3=\"no\" mod4=\"no\">\n"
+	"\t\t<key name=\"KEY_A\" code=\"0x0041\"/>\t<!-- A -->\n"
+	"\t\t<key name=\"KEY_B\" code=\"0x0042\"/>\t<!-- B -->\n"
+	"\t\t<dummy/>\n"
+	"\t</map>\n"
+	"\n"
+	"\t<!-- CONTROL -->\n"
+	"\t<map mod2=\"yes\">\n"
+	"\t\t<key name=\"KEY_A\" code=\"0x0001\"/>\n"
+	"\t\t<dummy/>\n"
+	"\t</map>\n"
+	"\n"
+	"\t<!-- dead-key / compose sequences -->\n"
+	"\t<sequence first=\"0x0301\" second=\"0x0061\" code=\"0x00e1\"/>\t<!-- á -->\n"
+	"\t<dummy/>\n"
+	"</chargen>";
+
+static char const *config_b =
+	"<chargen>\n"
+	"\t<map>\n"
+	"\t\t<key name=\"KEY_A\" code=\"0x0061\"/>\t<!-- a -->\n"
+	"\t\t<key name=\"KEY_B\" code=\"0x0063\"/>\t<!-- c -->\n"
+	"\t\t<key name=\"KEY_ESC\" ascii=\"27\"/>\n"
+	"\t\t<dummy/>\n"
+	"\t</map>\n"
+	"\n"
+	"\t<!-- ALTGR -->\n"
+	"\t<map mod1=\"no\" mod2=\"no\" mod3=\"yes\" mod4=\"no\">\n"
+	"\t\t<key name=\"KEY_E\" code=\"0x20ac\"/>\t<!-- € -->\n"
+	"\t\t<dummy/>\n"
+	"\t</map>\n"
+	"\n"
+	"\t<!-- dead-key / compose sequences -->\n"
+	"\t<sequence first=\"0x0301\" second=\"0x0065\" code=\"0x00e9\"/>\t<!-- é -->\n"
+	"\t<dummy/>\n"
+	"</chargen>";
+
+
+static unsigned long failures = 0;
+
+static void check(bool ok, char const *what)
+{
+	::printf("%s: %s\n", ok ? "ok    " : "FAILED", what);
+	if (!ok) ++failures;
+}
+
+
+static Chargen chargen(char const *xml) { return Chargen(xml, strlen(xml)); }
+
+
+static void check_minimal()
+{
+	for (char const *config : { config_a, config_b }) {
+		std::string const minimal = Config_text::minimal(config, strlen(config));
+
+		check(minimal.find("<!--") == std::string::npos
+		   && minimal.find("<dummy/>") == std::string::npos
+		   && minimal.find('\n') == std::string::npos,
+		      "minimal profile has no comments, dummy nodes, and whitespace");
+
+		check(Config_text::same_nodes(config, minimal),
+		      "minimal profile has the nodes of the annotated config");
+
+		check(chargen(minimal.c_str()) == chargen(config),
+		      "minimal profile parses to the same chargen");
+	}
+}
+
+
+static void check_delta()
+{
+	Chargen const from = chargen(config_a);
+	Chargen const to   = chargen(config_b);
+
+	Expanding_xml_buffer delta;
+	unsigned long changes = 0;
+	delta.generate("chargen_delta", [&] (Genode::Xml_generator &xml) {
+		changes = Chargen::generate_delta(xml, from, to); });
+
+	check(changes > 0, "delta has changes");
+
+	Chargen applied = from;
+	applied.apply_delta(delta.buffer(), strlen(delta.buffer()));
+	check(applied == to, "delta turns config into new config");
+
+	std::string const minimal = Config_text::minimal(delta.buffer(), strlen(delta.buffer()));
+	Chargen applied_minimal = from;
+	applied_minimal.apply_delta(minimal.c_str(), minimal.size());
+	check(applied_minimal == to, "minimal delta turns config into new config");
+
+	String_sink out, diag;
+	check(Xkb2ifcfg::apply_delta(config_a, delta.buffer(), config_b, out, diag) == 0,
+	      "apply_delta() result matches expected config");
+	check(Xkb2ifcfg::apply_delta(config_a, delta.buffer(), config_a, out, diag) == 1,
+	      "apply_delta() reports result differing from expected config");
+
+	bool rejected = false;
+	try { Xkb2ifcfg::apply_delta(delta.buffer(), config_b, nullptr, out, diag); }
+	catch (Xkb2ifcfg::Invalid_config) { rejected = true; }
+	check(rejected, "apply_delta() rejects swapped config and delta");
+
+	rejected = false;
+	try { chargen(delta.buffer()); }
+	catch (Chargen::Invalid_config) { rejected = true; }
+	check(rejected, "delta is rejected as config");
+
+	Expanding_xml_buffer empty;
+	empty.generate("chargen_delta", [&] (Genode::Xml_generator &xml) {
+		changes = Chargen::generate_delta(xml, to, to); });
+	check(changes == 0, "delta of equal configs is empty");
+}
+
+
+static void check_bundle()
+{
+	String_sink archive, diag;
+	{
+		Bundle bundle(diag);
+		bundle.add("a", config_a);
+		bundle.add("b", config_b);
+
+		check(bundle.write(archive) == 0, "bundle reproduces all configs");
+	}
+
+	String_sink list;
+	check(Bundle::extract(archive.data.data(), archive.data.size(), nullptr, list, diag) == 0
+	   && list.data == "a\nb\n", "extract lists layouts");
+
+	for (char const *name : { "a", "b" }) {
+		String_sink config;
+		Bundle::extract(archive.data.data(), archive.data.size(), name, config, diag);
+		check(chargen(config.data.c_str()) == chargen(*name == 'a' ? config_a : config_b),
+		      "extracted config matches bundled config");
+	}
+
+	String_sink none;
+	check(Bundle::extract(archive.data.data(), archive.data.size(), "c", none, diag) == 1,
+	      "extract reports unknown layout");
+
+	std::string corrupt = archive.data;
+	corrupt[4] ^= 0xff;  /* version */
+	bool rejected = false;
+	try { Bundle::extract(corrupt.data(), corrupt.size(), nullptr, none, diag); }
+	catch (Bundle::Invalid_bundle) { rejected = true; }
+	check(rejected, "extract rejects archive of other version");
+}
+
+
+/*
+ * Keymap with dead keys on the first keys and a compose table of three
+ * dead keys followed by one of two keysyms
+ *
+ * Each prefix of dead keys is followed by all keysyms of the keymap in
+ * the sequence search, which exceeds a budget of some hundred milliseconds
+ * and results in more than one MiB of output, the initial size of
+ * Expanding_xml_buffer.
+ */
+struct Budget_input
+{
+	enum { NUM_DEAD = 25 };
+
+	std::string keymap  { };
+	std::string compose { };
+
+	std::string _name(xkb_keysym_t keysym)
+	{
+		char buf[64];
+		xkb_keysym_get_name(keysym, buf, sizeof(buf));
+		return buf;
+	}
+
+	Budget_input()
+	{
+		keymap = "xkb_keymap {\n"
+		         "xkb_keycodes \"check\" {\n"
+		         "\tminimum = 8;\n"
+		         "\tmaximum = 255;\n";
+		for (Xkb::Mapping const &m : Xkb::printable)
+			keymap += Formatted("\t%s = %u;\n", m.xkb_name, m.xkb).string();
+
+		keymap += "};\n"
+		          "xkb_types \"check\" { };\n"
+		          "xkb_compat \"check\" { };\n"
+		          "xkb_symbols \"check\" {\n";
+
+		std::vector<xkb_keysym_t> dead, other;
+
+		unsigned i = 0;
+		for (Xkb::Mapping const &m : Xkb::printable) {
+			xkb_keysym_t const keysym = i < NUM_DEAD ? Xkb::dead_keysym[i].xkb
+			                                         : 0x1004e00 + i;
+			(i < NUM_DEAD ? dead : other).push_back(keysym);
+
+			keymap += Formatted("\tkey %s { [ %s ] };\n",
+			                    m.xkb_name, _name(keysym).c_str()).string();
+			++i;
+		}
+		keymap += "};\n"
+		          "};\n";
+
+		unsigned code = 0xa0;
+		for (xkb_keysym_t a : dead)
+			for (xkb_keysym_t b : dead)
+				for (xkb_keysym_t c : dead)
+					for (unsigned k = 0; k < 2; ++k)
+						compose += Formatted("<%s> <%s> <%s> <%s> : U%04X\n",
+						                     _name(a).c_str(), _name(b).c_str(),
+						                     _name(c).c_str(), _name(other[k]).c_str(),
+						                     code++).string();
+	}
+};
+
+
+static void check_budget()
+{
+	using Clock = std::chrono::steady_clock;
+
+	enum { MAX_TIME_MS = 300 };
+
+	Budget_input const input;
+
+	Xkb2ifcfg::Config config { "check", "", "C" };
+	config.keymap_text  = input.keymap.c_str();
+	config.compose_text = input.compose.c_str();
+	config.max_time_ms  = MAX_TIME_MS;
+
+	String_sink out, diag;
+	Generator generator(config, out, diag);
+
+	Clock::time_point const start = Clock::now();
+	generator.generate();
+	unsigned long const ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+		Clock::now() - start).count();
+
+	/*
+	 * The XML generation after the search adds to the budget, but the
+	 * budget must not be renewed when the buffer grows
+	 */
+	check(out.data.size() > 1024*1024, "output exceeds initial XML buffer");
+	check(ms < 2*MAX_TIME_MS,
+	      Formatted("generation takes %lu ms with --max-time=%u", ms,
+	                unsigned(MAX_TIME_MS)).string());
+}
+
+
+/*
+ * Keymap with Shift and an optional Level5 modifier key on the key A
+ */
+static std::string verify_keymap(bool level5)
+{
+	std::string keymap = "xkb_keymap {\n"
+	                     "xkb_keycodes \"check\" {\n"
+	                     "\tminimum = 8;\n"
+	                     "\tmaximum = 255;\n"
+	                     "\t<LFSH> = 50;\n"
+	                     "\t<MDSW> = 203;\n";
+	for (Xkb::Mapping const &m : Xkb::printable)
+		keymap += Formatted("\t%s = %u;\n", m.xkb_name, m.xkb).string();
+
+	keymap += "};\n"
+	          "xkb_types \"check\" {\n"
+	          "\ttype \"ONE_LEVEL\" { modifiers = none; };\n"
+	          "\ttype \"LEVEL5\" {\n"
+	          "\t\tmodifiers = Shift+Mod5;\n"
+	          "\t\tmap[Shift] = Level2;\n"
+	          "\t\tmap[Mod5] = Level3;\n"
+	          "\t\tmap[Shift+Mod5] = Level3;\n"
+	          "\t};\n"
+	          "};\n"
+	          "xkb_compat \"check\" { };\n"
+	          "xkb_symbols \"check\" {\n"
+	          "\tkey <LFSH> { [ Shift_L ], actions[Group1] = [ SetMods(modifiers=Shift) ] };\n"
+	          "\tkey <AC01> { type = \"LEVEL5\", [ a, A, b ] };\n"
+	          "\tmodifier_map Shift { <LFSH> };\n";
+	if (level5)
+		keymap += "\tkey <MDSW> { [ ISO_Level5_Shift ], actions[Group1] = [ SetMods(modifiers=Mod5) ] };\n"
+		          "\tmodifier_map Mod5 { <MDSW> };\n";
+	keymap += "};\n"
+	          "};\n";
+
+	return keymap;
+}
+
+
+static void check_verify()
+{
+	for (bool level5 : { false, true }) {
+		std::string const keymap = verify_keymap(level5);
+
+		Xkb2ifcfg::Config config { "check", "", "C" };
+		config.keymap_text  = keymap.c_str();
+		config.compose_text = "<Multi_key> <a> <b> : U00E6\n";
+
+		String_sink out, diag;
+		Generator generator(config, out, diag);
+
+		int const result = generator.verify();
+		bool const reported = out.data.find(level5 ? "not expressible: 2 "
+		                                           : "not expressible: 0 ")
+		                   != std::string::npos;
+
+		check(result == 0 && reported,
+		      level5 ? "verify reports Level5 as not expressible"
+		             : "verify of expressible keymap succeeds");
+	}
+}
+
+
+int main()
+{
+	try {
+		check_minimal();
+		check_delta();
+		check_bundle();
+		check_budget();
+		check_verify();
+	} catch (...) {
+		check(false, "unexpected exception");
+	}
+
+	::printf("%lu checks failed\n", failures);
+
+	return failures ? 1 : 0;
+}
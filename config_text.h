@@ -0,0 +1,269 @@
+/*
+ * \brief  Size report and minimal profile of chargen config text
+ * \author Christian Helmuth <christian.helmuth@genode-labs.com>
+ * \date   2026-10-18
+ *
+ * Copyright (C) 2026 Genode Labs GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _CONFIG_TEXT_H_
+#define _CONFIG_TEXT_H_
+
+/* Linux includes */
+#include <cctype>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/* Genode includes */
+#include <util/xml_node.h>
+
+#include "xkb2ifcfg.h"
+#include "xkb_mapping.h"
+
+
+/*
+ * Text of generated chargen configs
+ *
+ * The annotated config carries a comment per key and sequence, a <dummy/>
+ * node at the end of each map (see the FIXME in Engine::Map), and the
+ * indentation of Xml_generator. None of these are interpreted by
+ * input_filter. The text is split into tokens of markup (tags), dummy
+ * nodes, comments, and whitespace between tags. The minimal profile is
+ * the markup only.
+ */
+namespace Config_text {
+
+	enum class Token { MARKUP, DUMMY, COMMENT, WHITESPACE };
+
+	enum { NUM_TOKENS = 4 };
+
+	template <typename FN>
+	inline void for_each_token(char const *xml, size_t len, FN const &fn)
+	{
+		char const * const end = xml + len;
+
+		for (char const *s = xml; s < end; ) {
+			char const *e    = end;
+			Token       type = Token::MARKUP;
+
+			if (end - s >= 4 && !::strncmp(s, "<!--", 4)) {
+				if (char const *close = (char const *)::memmem(s, end - s, "-->", 3))
+					e = close + 3;
+				type = Token::COMMENT;
+
+			} else if (*s == '<') {
+				if (char const *close = (char const *)::memchr(s, '>', end - s))
+					e = close + 1;
+				if (e - s == 8 && !::strncmp(s, "<dummy/>", 8))
+					type = Token::DUMMY;
+
+			} else {
+				if (char const *open = (char const *)::memchr(s, '<', end - s))
+					e = open;
+
+				type = Token::WHITESPACE;
+				for (char const *c = s; c < e; ++c)
+					if (!::isspace((unsigned char)*c)) type = Token::MARKUP;
+			}
+
+			fn(type, s, size_t(e - s));
+			s = e;
+		}
+	}
+
+	/*
+	 * Return config text without comments, dummy nodes, and whitespace
+	 */
+	inline std::string minimal(char const *xml, size_t len)
+	{
+		std::string result;
+		result.reserve(len);
+
+		for_each_token(xml, len, [&] (Token type, char const *s, size_t n) {
+			if (type == Token::MARKUP) result.append(s, n); });
+
+		return result;
+	}
+
+	/*
+	 * Number of nodes of XML node and its sub nodes (<dummy/> nodes only
+	 * if 'dummies' is true)
+	 */
+	inline unsigned long num_nodes(Genode::Xml_node node, bool dummies)
+	{
+		unsigned long result = 1;
+
+		node.for_each_sub_node([&] (Genode::Xml_node sub) {
+			if (dummies || !sub.has_type("dummy")) result += num_nodes(sub, dummies); });
+
+		return result;
+	}
+
+	/*
+	 * Return true if the minimal text has the nodes of the annotated text
+	 * except <dummy/> nodes
+	 */
+	inline bool same_nodes(char const *annotated, std::string const &minimal)
+	{
+		try {
+			return num_nodes(Genode::Xml_node(annotated, ::strlen(annotated)), false)
+			    == num_nodes(Genode::Xml_node(minimal.c_str(), minimal.size()), true);
+		} catch (Genode::Xml_node::Invalid_syntax) { return false; }
+	}
+
+	class Size_report;
+}
+
+
+/*
+ * Bytes of config text per part (map, sequences, and other) and token type
+ *
+ * Comments and whitespace between maps (e.g., the name of the following
+ * map) are accounted to the "other" part, comments of sequences to the
+ * sequences part.
+ */
+class Config_text::Size_report
+{
+	private:
+
+		struct Part
+		{
+			std::string name;
+			size_t      bytes[NUM_TOKENS] { };
+
+			size_t total() const
+			{
+				size_t result = 0;
+				for (size_t b : bytes) result += b;
+				return result;
+			}
+
+			void add(Part const &o)
+			{
+				for (unsigned i = 0; i < NUM_TOKENS; ++i) bytes[i] += o.bytes[i];
+			}
+		};
+
+		std::vector<Part> _maps      { };
+		Part              _sequences { "sequences" };
+		Part              _other     { "other" };
+
+		Part *_current { &_other };
+
+		/*
+		 * Name of map from the modifier attributes of its tag
+		 */
+		static std::string _map_name(char const *tag, size_t len)
+		{
+			std::string const t(tag, len);
+			std::string       result;
+
+			for (Xkb::Modifier const &m : Xkb::modifier) {
+				if (t.find(std::string(m.attr) + "=\"yes\"") == std::string::npos)
+					continue;
+
+				if (!result.empty()) result += "-";
+				result += m.name;
+			}
+			if (result.empty()) result = "NONE";
+
+			return result;
+		}
+
+		static bool _starts(char const *s, size_t len, char const *prefix)
+		{
+			size_t const n = strlen(prefix);
+			return len >= n && !::strncmp(s, prefix, n);
+		}
+
+	public:
+
+		/*
+		 * Account text to the report
+		 *
+		 * The text may be added in pieces (e.g., header comment and
+		 * config) as long as no token is split.
+		 */
+		void add(char const *xml, size_t len)
+		{
+			for_each_token(xml, len, [&] (Token type, char const *s, size_t n) {
+
+				bool const tag = type == Token::MARKUP && *s == '<';
+
+				if (tag && (_starts(s, n, "<map ") || _starts(s, n, "<map>")
+				                                   || _starts(s, n, "<map/>"))) {
+					_maps.push_back(Part { _map_name(s, n) });
+					_current = &_maps.back();
+				}
+				if (tag && _current == &_other && _starts(s, n, "<sequence"))
+					_current = &_sequences;
+				if (tag && _starts(s, n, "</chargen"))
+					_current = &_other;
+
+				_current->bytes[unsigned(type)] += n;
+
+				/* text after the end of a map is not part of it */
+				if (tag && (_starts(s, n, "</map") || (_starts(s, n, "<map") && s[n - 2] == '/')))
+					_current = &_other;
+			});
+		}
+
+		/*
+		 * Size of the minimal profile
+		 */
+		size_t minimal() const
+		{
+			size_t result = _sequences.bytes[unsigned(Token::MARKUP)]
+			              + _other.bytes[unsigned(Token::MARKUP)];
+			for (Part const &p : _maps) result += p.bytes[unsigned(Token::MARKUP)];
+
+			return result;
+		}
+
+		void print(Xkb2ifcfg::Sink &sink) const
+		{
+			Part total { "total" };
+
+			auto print_part = [&] (Part const &p) {
+				sink.printf("%-24s %8zu %8zu %8zu %8zu %10zu\n", p.name.c_str(),
+				            p.total(),
+				            p.bytes[unsigned(Token::MARKUP)],
+				            p.bytes[unsigned(Token::DUMMY)],
+				            p.bytes[unsigned(Token::COMMENT)],
+				            p.bytes[unsigned(Token::WHITESPACE)]);
+			};
+
+			sink.printf("%-24s %8s %8s %8s %8s %10s\n",
+			            "part", "total", "markup", "dummy", "comments", "whitespace");
+
+			for (Part const &p : _maps) { print_part(p); total.add(p); }
+			print_part(_sequences); total.add(_sequences);
+			print_part(_other);     total.add(_other);
+			print_part(total);
+
+			size_t const annotated = total.total();
+			sink.printf("\nminimal profile: %zu bytes (%.1f%% of annotated)\n",
+			            minimal(), annotated ? 100.0*minimal()/annotated : 0.0);
+		}
+};
+
+#endif /* _CONFIG_TEXT_H_ */
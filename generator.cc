@@ -0,0 +1,1911 @@
+/*
+ * \brief  Libxkbcommon-based keyboard-layout generator
+ * \author Christian Helmuth <christian.helmuth@genode-labs.com>
+ * \date   2019-07-16
+ *
+ * Copyright (C) 2019 Genode Labs GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Linux includes */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <xkbcommon/xkbcommon-compose.h>
+#include <set>
+#include <vector>
+#include <stdexcept>
+#include <thread>
+#include <map>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+
+/* Genode includes */
+#include <util/xml_generator.h>
+#include <util/reconstructible.h>
+
+#include "xkb2ifcfg.h"
+#include "xkb_mapping.h"
+#include "keymap_cache.h"
+#include "chargen.h"
+#include "config_text.h"
+#include "xml_buffer.h"
+#include "util.h"
+
+using Genode::Xml_generator;
+using Genode::Constructible;
+using Xkb2ifcfg::Sink;
+using Xkb2ifcfg::Engine;
+
+
+void Sink::printf(char const *format, ...)
+{
+	va_list list;
+	va_start(list, format);
+	Formatted str(format, list);
+	va_end(list);
+
+	write(str.string(), strlen(str.string()));
+}
+
+
+static void append_comment(Xml_generator &xml, char const *prefix,
+                           char const *comment, char const *suffix)
+{
+	xml.append(prefix);
+	xml.append("<!-- "); xml.append(comment); xml.append(" -->");
+	xml.append(suffix);
+}
+
+
+/* C0 control character or DEL as produced by the control modifier */
+static bool control_character(unsigned utf32)
+{
+	return (utf32 && utf32 <= 0x1f) || utf32 == 0x7f;
+}
+
+
+static bool keysym_composing(xkb_compose_state *compose_state, xkb_keysym_t sym)
+{
+	xkb_compose_state_reset(compose_state);
+	xkb_compose_state_feed(compose_state, sym);
+
+	return (XKB_COMPOSE_COMPOSING == xkb_compose_state_get_status(compose_state));
+}
+
+
+/*
+ * Per-run cache of keysym properties
+ *
+ * Maps, sequence comments, and the info command query the same keysyms
+ * over and over. Each keysym is resolved once on first lookup, which
+ * avoids repeated feeding of the compose state and conversions in
+ * libxkbcommon. The cache is not thread safe and uses its compose state
+ * exclusively.
+ */
+class Keysym_cache
+{
+	public:
+
+		struct Entry
+		{
+			unsigned utf32     { 0 };
+			bool     composing { false };
+			char     utf8[8]   { };   /* xkb_keysym_to_utf8() needs 7 bytes */
+			char     name[32]  { };
+		};
+
+		struct Stats
+		{
+			unsigned long hits   { 0 };
+			unsigned long misses { 0 };
+
+			Stats & operator += (Stats const &other)
+			{
+				hits   += other.hits;
+				misses += other.misses;
+				return *this;
+			}
+
+			void print(Sink &sink) const
+			{
+				sink.printf("keysym cache: %lu lookups, %lu hits, %lu misses\n",
+				            hits + misses, hits, misses);
+			}
+		};
+
+	private:
+
+		xkb_compose_state *_compose_state;
+
+		std::unordered_map<xkb_keysym_t, Entry> _entries { };
+
+		Stats _stats { };
+
+	public:
+
+		Keysym_cache(xkb_compose_state *compose_state) : _compose_state(compose_state) { }
+
+		Entry const & lookup(xkb_keysym_t keysym)
+		{
+			auto const it = _entries.find(keysym);
+			if (it != _entries.end()) {
+				++_stats.hits;
+				return it->second;
+			}
+
+			++_stats.misses;
+
+			Entry &entry = _entries[keysym];
+
+			entry.utf32     = xkb_keysym_to_utf32(keysym);
+			entry.composing = keysym_composing(_compose_state, keysym);
+			xkb_keysym_to_utf8(keysym, entry.utf8, sizeof(entry.utf8));
+			xkb_keysym_get_name(keysym, entry.name, sizeof(entry.name));
+
+			return entry;
+		}
+
+		Stats const & stats() const { return _stats; }
+
+		/*
+		 * Discount the lookups since 'snapshot' before a pass is repeated
+		 *
+		 * Keysyms resolved in the discarded pass stay counted as misses,
+		 * so the statistics of the repeated pass match a single pass.
+		 */
+		void discount(Stats const &snapshot)
+		{
+			_stats.hits = snapshot.hits + snapshot.misses - _stats.misses;
+		}
+};
+
+
+struct Key_info
+{
+	xkb_keysym_t  _keysym    { XKB_KEY_NoSymbol };
+	bool          _composing { false };
+	bool          _unmapped  { false }; /* composing keysym without UTF32 mapping */
+	unsigned      _utf32     { 0 };
+	char const   *_comment   { "" };
+	char          _utf8[8]   { };
+
+	Key_info(xkb_state *state, Keysym_cache &cache, Input::Keycode code)
+	{
+		xkb_keycode_t const keycode = Xkb::keycode(code);
+
+		_keysym = xkb_state_key_get_one_sym(state, keycode);
+		if (_keysym == XKB_KEY_NoSymbol) return;
+
+		Keysym_cache::Entry const &entry = cache.lookup(_keysym);
+
+		_composing = entry.composing;
+
+		if (!_composing) {
+			/*
+			 * The state may transform the character of the keysym (e.g.,
+			 * on Control), so the cached UTF-8 is used only if it matches.
+			 */
+			_utf32 = xkb_state_key_get_utf32(state, keycode);
+			if (_utf32 == entry.utf32) {
+				_comment = entry.utf8;
+			} else {
+				xkb_state_key_get_utf8(state, keycode, _utf8, sizeof(_utf8));
+				_comment = _utf8;
+			}
+		} else {
+			for (Xkb::Dead_keysym const &d : Xkb::dead_keysym) {
+				if (d.xkb != _keysym) continue;
+
+				_utf32   = d.utf32;
+				_comment = entry.name;
+				return;
+			}
+			_unmapped = true;
+		}
+	}
+
+	bool valid()          const { return _utf32  != 0; }
+	xkb_keysym_t keysym() const { return _keysym; }
+	bool composing()      const { return _composing; }
+	bool unmapped()       const { return _unmapped; }
+	unsigned utf32()      const { return _utf32; }
+
+	void attributes(Xml_generator &xml)
+	{
+		xml.attribute("code", Formatted("0x%04x", _utf32).string());
+	}
+
+	void comment(Xml_generator &xml)
+	{
+		append_comment(xml, "\t", _comment, "");
+	}
+};
+
+
+struct Keysym
+{
+	bool         composing { 0 };
+	xkb_keysym_t keysym    { 0 };
+	unsigned     utf32     { 0 };
+};
+
+
+static bool operator < (Keysym const &a, Keysym const &b)
+{
+	return a.keysym < b.keysym;
+}
+
+
+/*
+ * Reference to libxkbcommon object released on destruction or assignment
+ */
+template <typename T, void (*UNREF)(T *)>
+class Xkb_ref
+{
+	private:
+
+		T *_ptr { nullptr };
+
+	public:
+
+		Xkb_ref() { }
+
+		~Xkb_ref() { if (_ptr) UNREF(_ptr); }
+
+		Xkb_ref(Xkb_ref const &) = delete;
+		Xkb_ref & operator = (Xkb_ref const &) = delete;
+
+		Xkb_ref & operator = (T *ptr)
+		{
+			if (_ptr) UNREF(_ptr);
+			_ptr = ptr;
+			return *this;
+		}
+
+		operator T * () const { return _ptr; }
+};
+
+
+template <Input::Keycode code>
+struct Locked
+{
+	xkb_state *state;
+
+	Locked(xkb_state *state) : state(state)
+	{
+		xkb_state_update_key(state, Xkb::keycode(code), XKB_KEY_DOWN);
+		xkb_state_update_key(state, Xkb::keycode(code), XKB_KEY_UP);
+	}
+
+	~Locked()
+	{
+		xkb_state_update_key(state, Xkb::keycode(code), XKB_KEY_DOWN);
+		xkb_state_update_key(state, Xkb::keycode(code), XKB_KEY_UP);
+	}
+};
+
+
+class Xkb2ifcfg::Engine
+{
+	private:
+
+		struct Map;
+		struct Sequence;
+		struct Verify;
+
+		/*
+		 * Config with copies of all strings, which need not outlive the
+		 * constructor of the generator
+		 */
+		struct Config_copy : Config
+		{
+			std::list<std::string> _strings { };
+
+			char const * _copy(char const *s)
+			{
+				if (!s) return nullptr;
+
+				_strings.emplace_back(s);
+				return _strings.back().c_str();
+			}
+
+			Config_copy(Config const &config) : Config(config)
+			{
+				for (char const **s : { &layout, &variant, &locale, &model, &options,
+				                        &cache_dir, &maps, &keys, &dead,
+				                        &keymap_text, &compose_text })
+					*s = _copy(*s);
+			}
+
+			Config_copy(Config_copy const &) = delete;
+			Config_copy & operator = (Config_copy const &) = delete;
+		};
+
+		Config_copy const _config;
+		Sink        &_out;
+		Sink        &_diag;
+
+		Xkb::Model const &_model;
+
+		/* released in reverse order, also if the constructor throws */
+		Xkb_ref<xkb_context,       xkb_context_unref>       _context       { };
+		xkb_rule_names                                      _rmlvo         { };
+		Xkb_ref<xkb_keymap,        xkb_keymap_unref>        _keymap        { };
+		Xkb_ref<xkb_state,         xkb_state_unref>         _state         { };
+		Xkb_ref<xkb_compose_table, xkb_compose_table_unref> _compose_table { };
+		Xkb_ref<xkb_compose_state, xkb_compose_state_unref> _compose_state { };
+
+		std::set<Keysym> _keysyms;
+
+		/* keysym properties (uses _compose_state) */
+		Constructible<Keysym_cache> _keysym_cache;
+
+		/*
+		 * Selected parts of the generated config (see Config)
+		 */
+		struct Selection
+		{
+			bool                   partial { false };
+			std::set<unsigned>     maps    { };  /* bit masks of Xkb::modifier */
+			std::set<unsigned>     keys    { };  /* Input::Keycode */
+			std::set<xkb_keysym_t> dead    { };  /* first keysyms of sequences */
+
+			bool map(unsigned mods)         const { return !partial || maps.count(mods); }
+			bool key(Input::Keycode code)   const { return keys.empty() || keys.count(code); }
+			bool sequences()                const { return !partial || !dead.empty(); }
+			bool first(xkb_keysym_t keysym) const { return dead.empty() || dead.count(keysym); }
+		};
+
+		Selection const _selection;
+
+		/*
+		 * Numpad keys are remapped in input_filter if numlock=off, so we
+		 * always assume numlock=on to handle KP1 etc. correctly.
+		 */
+		Constructible<Locked<Input::KEY_NUMLOCK>> _numlock;
+
+		enum { NUM_MODIFIERS = sizeof(Xkb::modifier)/sizeof(Xkb::modifier[0]) };
+
+		/*
+		 * Modifier state of the base state (numlock=on) and the emulated
+		 * modifier keys of Xkb::modifier
+		 */
+		struct Mod_state
+		{
+			xkb_mod_mask_t depressed { 0 };
+			xkb_mod_mask_t latched   { 0 };
+			xkb_mod_mask_t locked    { 0 };
+
+			Mod_state() { }
+
+			Mod_state(xkb_state *state)
+			:
+				depressed(xkb_state_serialize_mods(state, XKB_STATE_MODS_DEPRESSED)),
+				latched  (xkb_state_serialize_mods(state, XKB_STATE_MODS_LATCHED)),
+				locked   (xkb_state_serialize_mods(state, XKB_STATE_MODS_LOCKED))
+			{ }
+
+			xkb_mod_mask_t effective() const { return depressed | latched | locked; }
+		};
+
+		Mod_state _base_mods                     { };
+		Mod_state _modifier_mods[NUM_MODIFIERS] { };
+
+		/* utilities */
+		char const * _string(enum xkb_compose_status);
+		char const * _string(enum xkb_compose_feed_result);
+
+		void _keycode_info(xkb_keycode_t);
+		void _keycode_xml_non_printable(Xml_generator &, xkb_keycode_t);
+		void _keycode_xml_control(Xml_generator &, xkb_keycode_t, Map const &);
+		void _keycode_xml_printable(Xml_generator &, xkb_keycode_t);
+
+		void _update_state(unsigned);
+
+		unsigned _combined_control_utf32(Xkb::Mapping const &);
+		bool     _combined_control_differs(Xkb::Mapping const &, Map const &);
+		unsigned _control_fallback(Xkb::Mapping const &, unsigned);
+
+		void _collect_keysyms();
+
+		bool _generate_chargen(Expanding_xml_buffer &);
+		bool _check_minimal(char const *config, std::string const &minimal);
+
+		static Xkb::Model const & _lookup_model(char const *);
+		static Selection _select(Config const &, Xkb::Model const &);
+
+	public:
+
+		Engine(Config const &, Sink &output, Sink &diag);
+
+		xkb_keymap * keymap() { return _keymap; }
+
+		xkb_layout_index_t num_groups() { return xkb_keymap_num_layouts(_keymap); }
+
+		int generate();
+		int delta(char const *previous);
+		int size();
+		int dump();
+		int info();
+		int verify();
+};
+
+
+struct Engine::Map
+{
+	Engine        &main;
+	Xml_generator &xml;
+
+	/* bit mask of Xkb::modifier */
+	unsigned const mods;
+
+	struct Name
+	{
+		char string[64] { };
+
+		Name(unsigned mods)
+		{
+			for (unsigned i = 0; i < NUM_MODIFIERS; ++i) {
+				if (!(mods & (1u << i))) continue;
+
+				if (string[0]) strncat(string, "-", sizeof(string) - strlen(string) - 1);
+				strncat(string, Xkb::modifier[i].name, sizeof(string) - strlen(string) - 1);
+			}
+			if (!string[0]) strncat(string, "no modifier", sizeof(string) - 1);
+		}
+	};
+
+	static unsigned control_mods(unsigned mods)
+	{
+		unsigned result = 0;
+
+		for (unsigned i = 0; i < NUM_MODIFIERS; ++i)
+			if ((mods & (1u << i)) && Xkb::modifier[i].control) result |= 1u << i;
+
+		return result;
+	}
+
+	static bool control(unsigned mods) { return control_mods(mods) != 0; }
+
+	/* control modifiers combined with others */
+	static bool combined_control(unsigned mods) {
+		return control(mods) && control_mods(mods) != mods; }
+
+	/*
+	 * Modifier combinations of all generated maps
+	 *
+	 * Combinations are ordered by the number of modifiers.
+	 */
+	static std::vector<unsigned> all()
+	{
+		std::vector<unsigned> result;
+
+		for (unsigned count = 0; count <= NUM_MODIFIERS; ++count) {
+			for (unsigned mods = 0; mods < (1u << NUM_MODIFIERS); ++mods) {
+				if (unsigned(__builtin_popcount(mods)) != count) continue;
+
+				result.push_back(mods);
+			}
+		}
+		return result;
+	}
+
+	static void _non_printable(xkb_keymap *, xkb_keycode_t keycode, void *data)
+	{
+		Map &m = *reinterpret_cast<Map *>(data);
+
+		m.main._keycode_xml_non_printable(m.xml, keycode);
+	}
+
+	static void _control(xkb_keymap *, xkb_keycode_t keycode, void *data)
+	{
+		Map &m = *reinterpret_cast<Map *>(data);
+
+		m.main._keycode_xml_control(m.xml, keycode, m);
+	}
+
+	static void _printable(xkb_keymap *, xkb_keycode_t keycode, void *data)
+	{
+		Map &m = *reinterpret_cast<Map *>(data);
+
+		m.main._keycode_xml_printable(m.xml, keycode);
+	}
+
+	/*
+	 * Characters input_filter takes from maps with fewer conditions
+	 *
+	 * Only used for combined control maps, which omit keys that result in
+	 * the same character anyway.
+	 */
+	std::map<xkb_keycode_t, unsigned> fallback { };
+
+	Map(Engine &main, Xml_generator &xml, unsigned mods)
+	:
+		main(main), xml(xml), mods(mods)
+	{
+		if (combined_control(mods))
+			for (Xkb::Mapping const &m : main._model.printable)
+				fallback[m.xkb] = main._control_fallback(m, control_mods(mods));
+
+		main._update_state(mods);
+
+		if (combined_control(mods)) {
+			bool differs = false;
+			for (Xkb::Mapping const &m : main._model.printable)
+				if (main._selection.key(m.code) && main._combined_control_differs(m, *this))
+					differs = true;
+
+			/* skip map that does not change the characters */
+			if (!differs) return;
+		}
+
+		if (mods == 0) {
+			/* generate basic character map */
+			xml.node("map", [&] ()
+			{
+				append_comment(xml, "\n\t\t", "printable", "");
+				xkb_keymap_key_for_each(main.keymap(), _printable, this);
+
+				append_comment(xml, "\n\n\t\t", "non-printable", "");
+				xkb_keymap_key_for_each(main.keymap(), _non_printable, this);
+
+				/* FIXME xml.append() as last operation breaks indentation */
+				xml.node("dummy", [] () {});
+			});
+
+		} else if (control(mods) && !combined_control(mods)) {
+			/* generate control character map */
+			append_comment(xml, "\n\n\t", Name(mods).string, "");
+			xml.node("map", [&] ()
+			{
+				for (unsigned i = 0; i < NUM_MODIFIERS; ++i)
+					if (mods & (1u << i))
+						xml.attribute(Xkb::modifier[i].attr, true);
+
+				xkb_keymap_key_for_each(main.keymap(), _control, this);
+
+				/* FIXME xml.append() as last operation breaks indentation */
+				xml.node("dummy", [] () {});
+			});
+
+		} else {
+
+			/*
+			 * generate characters depending on modifier state
+			 *
+			 * Control combined with other modifiers results in control
+			 * characters as well as printable characters (e.g.,
+			 * AltGr-Control), which differ from the control map or the
+			 * basic map.
+			 */
+			append_comment(xml, "\n\n\t", Name(mods).string, "");
+			xml.node("map", [&] ()
+			{
+				for (unsigned i = 0; i < NUM_MODIFIERS; ++i)
+					xml.attribute(Xkb::modifier[i].attr, (bool)(mods & (1u << i)));
+
+				xkb_keymap_key_for_each(main.keymap(),
+				                        control(mods) ? _control : _printable, this);
+
+				/* FIXME xml.append() as last operation breaks indentation */
+				xml.node("dummy", [] () {});
+			});
+		}
+	}
+
+	~Map() { main._update_state(0); }
+};
+
+
+struct Engine::Sequence
+{
+	enum { MAX_LENGTH = 4 }; /* first, second, third, fourth */
+
+	using Clock = std::chrono::steady_clock;
+
+	/*
+	 * Bounds of the search (0 means unlimited)
+	 */
+	struct Budget
+	{
+		unsigned long max_nodes;
+		unsigned long max_time_ms;
+	};
+
+	struct Stats
+	{
+		unsigned long visited   { 0 };
+		unsigned long pruned    { 0 };
+		unsigned long too_long  { 0 };
+		unsigned long multiple  { 0 };  /* results that are no single character */
+		bool          pruning   { false };
+		bool          exhausted { false };
+
+		void print(Sink &sink) const
+		{
+			sink.printf("sequence search: %lu nodes visited, %lu pruned%s, "
+			            "%lu too long (max=%u), %lu skipped (no single character)\n",
+			            visited, pruned, pruning ? "" : " (pruning not supported)",
+			            too_long, unsigned(MAX_LENGTH), multiple);
+			if (exhausted)
+				sink.printf("sequence search: budget exhausted, sequences incomplete\n");
+		}
+	};
+
+	struct Guard
+	{
+		std::vector<Keysym> &seq;
+
+		Guard(std::vector<Keysym> &seq, Keysym keysym) : seq(seq) { seq.push_back(keysym); }
+		~Guard() { seq.pop_back(); }
+	};
+
+	/*
+	 * Sequence found by the search
+	 */
+	struct Result
+	{
+		std::vector<Keysym> seq;
+		unsigned            code;
+		std::string         comment;
+	};
+
+	Engine       &_main;
+	Budget const  _budget;
+	Stats        &_stats;
+
+	std::vector<Result> _results { };
+
+	Clock::time_point const _deadline {
+		_budget.max_time_ms ? Clock::now() + std::chrono::milliseconds(_budget.max_time_ms)
+		                    : Clock::time_point::max() };
+
+	/* not shared with the keysym cache, which resets its compose state */
+	xkb_compose_state *_state { xkb_compose_state_new(_main._compose_table,
+	                                                  XKB_COMPOSE_STATE_NO_FLAGS) };
+
+	/*
+	 * Keysyms that may follow a prefix according to the compose table
+	 */
+	std::map<std::vector<xkb_keysym_t>, std::set<xkb_keysym_t>> _follow { };
+
+	void _collect_follow_sets()
+	{
+#ifdef HAVE_XKB_COMPOSE_TABLE_ITERATOR
+		xkb_compose_table_iterator *it = xkb_compose_table_iterator_new(_main._compose_table);
+
+		while (xkb_compose_table_entry *entry = xkb_compose_table_iterator_next(it)) {
+			size_t length = 0;
+			xkb_keysym_t const *syms = xkb_compose_table_entry_sequence(entry, &length);
+
+			if (length > MAX_LENGTH) {
+				++_stats.too_long;
+				continue;
+			}
+
+			std::vector<xkb_keysym_t> prefix;
+			for (size_t i = 0; i < length; ++i) {
+				_follow[prefix].insert(syms[i]);
+				prefix.push_back(syms[i]);
+			}
+		}
+
+		xkb_compose_table_iterator_free(it);
+
+		_stats.pruning = true;
+#endif
+	}
+
+	std::set<xkb_keysym_t> const * _follow_set(std::vector<Keysym> const &seq) const
+	{
+		if (!_stats.pruning) return nullptr;
+
+		std::vector<xkb_keysym_t> prefix;
+		for (Keysym k : seq) prefix.push_back(k.keysym);
+
+		auto const it = _follow.find(prefix);
+
+		static std::set<xkb_keysym_t> const empty;
+		return it != _follow.end() ? &it->second : &empty;
+	}
+
+	bool _budget_exhausted()
+	{
+		if (_stats.exhausted) return true;
+
+		if ((_budget.max_nodes && _stats.visited >= _budget.max_nodes)
+		 || Clock::now() >= _deadline)
+			_stats.exhausted = true;
+
+		return _stats.exhausted;
+	}
+
+	/*
+	 * Visit keysyms of the keymap that may follow 'seq'
+	 */
+	template <typename FUNC>
+	void _for_each_follower(std::vector<Keysym> const &seq, FUNC const &fn)
+	{
+		std::set<xkb_keysym_t> const *follow = _follow_set(seq);
+
+		for (Keysym k : _main._keysyms) {
+			if (follow && !follow->count(k.keysym)) {
+				++_stats.pruned;
+				continue;
+			}
+			fn(k);
+		}
+	}
+
+	/*
+	 * Codepoint of UTF-8 string of exactly one character (0 otherwise)
+	 */
+	static unsigned _single_codepoint(char const *utf8)
+	{
+		unsigned char const *s = (unsigned char const *)utf8;
+
+		unsigned length = s[0] < 0x80 ? 1 : s[0] >= 0xf0 ? 4 : s[0] >= 0xe0 ? 3
+		                : s[0] >= 0xc0 ? 2 : 0;
+		if (!s[0] || !length) return 0;
+
+		unsigned result = length == 1 ? s[0] : s[0] & (0x7f >> length);
+		for (unsigned i = 1; i < length; ++i) {
+			if ((s[i] & 0xc0) != 0x80) return 0;
+			result = (result << 6) | (s[i] & 0x3f);
+		}
+		return s[length] ? 0 : result;
+	}
+
+	void _generate(std::vector<Keysym> &seq, Keysym keysym)
+	{
+		if (_budget_exhausted()) return;
+
+		++_stats.visited;
+
+		Guard g(seq, keysym);
+
+		if (seq.size() > MAX_LENGTH) {
+			++_stats.too_long;
+			return;
+		}
+
+		xkb_compose_state_reset(_state);
+		for (Keysym k : seq) xkb_compose_state_feed(_state, k.keysym);
+
+		switch (xkb_compose_state_get_status(_state)) {
+		case XKB_COMPOSE_COMPOSED: {
+				xkb_keysym_t const result = xkb_compose_state_get_one_sym(_state);
+
+				Keysym_cache::Entry const &entry = _main._keysym_cache->lookup(result);
+
+				/*
+				 * Results without keysym are strings, of which only single
+				 * characters can be expressed by the chargen
+				 */
+				char utf8[64] = { 0 };
+				unsigned code = entry.utf32;
+				if (result == XKB_KEY_NoSymbol) {
+					xkb_compose_state_get_utf8(_state, utf8, sizeof(utf8));
+					code = _single_codepoint(utf8);
+				}
+				if (!code) {
+					++_stats.multiple;
+					break;
+				}
+
+				_results.push_back({ seq, code, result == XKB_KEY_NoSymbol ? utf8 : entry.utf8 });
+			} break;
+
+		case XKB_COMPOSE_COMPOSING:
+			_for_each_follower(seq, [&] (Keysym k) { _generate(seq, k); });
+			break;
+
+		case XKB_COMPOSE_CANCELLED:
+		case XKB_COMPOSE_NOTHING:
+			break;
+		}
+	}
+
+	/*
+	 * Search sequences of the keysyms of the keymap
+	 *
+	 * The search runs once in the constructor. Hence, the budget is not
+	 * renewed if the XML generation is repeated with a larger buffer.
+	 */
+	Sequence(Engine &main, Budget budget, Stats &stats)
+	:
+		_main(main), _budget(budget), _stats(stats)
+	{
+		_stats = Stats();
+		_collect_follow_sets();
+
+		std::vector<Keysym> seq;
+		_for_each_follower(seq, [&] (Keysym k) {
+			/* first must be a dead/composing keysym */
+			if (k.composing && _main._selection.first(k.keysym)) _generate(seq, k); });
+	}
+
+	void generate(Xml_generator &xml) const
+	{
+		append_comment(xml, "\n\n\t", "dead-key / compose sequences", "");
+
+		for (Result const &r : _results) {
+			xml.node("sequence", [&] ()
+			{
+				try {
+					xml.attribute("first",  Formatted("0x%04x", r.seq.at(0).utf32).string());
+					xml.attribute("second", Formatted("0x%04x", r.seq.at(1).utf32).string());
+					xml.attribute("third",  Formatted("0x%04x", r.seq.at(2).utf32).string());
+					xml.attribute("fourth", Formatted("0x%04x", r.seq.at(3).utf32).string());
+				} catch (std::out_of_range) { }
+
+				xml.attribute("code", Formatted("0x%04x", r.code).string());
+			});
+
+			append_comment(xml, "\t", r.comment.c_str(), "");
+		}
+
+		/* FIXME xml.append() as last operation breaks indentation */
+		xml.node("dummy", [] () {});
+	}
+
+	~Sequence() { xkb_compose_state_unref(_state); }
+};
+
+
+/*
+ * Differential check of the generated chargen against libxkbcommon
+ *
+ * The generated maps cover the combinations of Xkb::modifier only.
+ * Verify enumerates all modifier states reachable by the modifier keys of
+ * the keymap and compares the character produced by libxkbcommon for each
+ * printable key with the character the generated config produces. The
+ * generated maps are parsed back with Chargen and keys are resolved like
+ * input_filter does.
+ * The modifier states are distributed over worker threads, each with its
+ * own xkb_state and xkb_compose_state (the keymap and compose table are
+ * only read concurrently).
+ */
+struct Engine::Verify
+{
+	/*
+	 * Modifier state with lock and latch modifiers kept apart from
+	 * depressed modifiers (e.g., Caps_Lock locks Lock)
+	 */
+	struct State
+	{
+		Mod_state mods;
+
+		xkb_mod_mask_t effective() const { return mods.effective(); }
+
+		bool operator < (State const &o) const
+		{
+			if (mods.depressed != o.mods.depressed) return mods.depressed < o.mods.depressed;
+			if (mods.latched   != o.mods.latched)   return mods.latched   < o.mods.latched;
+			return mods.locked < o.mods.locked;
+		}
+	};
+
+	struct Mismatch
+	{
+		State    state;
+		unsigned key;    /* index into printable keys of model */
+		unsigned xkb;
+		unsigned chargen;
+	};
+
+	static bool _less(Mismatch const &a, Mismatch const &b)
+	{
+		if (a.state.effective() != b.state.effective())
+			return a.state.effective() < b.state.effective();
+		if (a.state < b.state || b.state < a.state) return a.state < b.state;
+		return a.key < b.key;
+	}
+
+	struct Result
+	{
+		unsigned long         checked { 0 };
+		std::vector<Mismatch> mismatches { };
+		std::vector<Mismatch> inexpressible { };
+		std::set<unsigned>    reachable { };
+	};
+
+	struct Worker
+	{
+		Verify            &verify;
+		unsigned const     first;
+		unsigned const     stride;
+		xkb_state         *state         { xkb_state_new(verify._main._keymap) };
+		xkb_state         *chargen_state { xkb_state_new(verify._main._keymap) };
+		xkb_compose_state *compose_state { xkb_compose_state_new(verify._main._compose_table,
+		                                                         XKB_COMPOSE_STATE_NO_FLAGS) };
+		Keysym_cache       keysym_cache  { compose_state };
+		Result             result        { };
+
+		Worker(Verify &verify, unsigned first, unsigned stride)
+		: verify(verify), first(first), stride(stride) { }
+
+		~Worker()
+		{
+			xkb_compose_state_unref(compose_state);
+			xkb_state_unref(chargen_state);
+			xkb_state_unref(state);
+		}
+
+		void run()
+		{
+			for (unsigned i = first; i < verify._states.size(); i += stride) {
+				State const s = verify._states[i];
+
+				xkb_state_update_mask(state, s.mods.depressed, s.mods.latched,
+				                      s.mods.locked, 0, 0, 0);
+
+				Mod_state const c = verify._chargen_mods(s);
+				xkb_state_update_mask(chargen_state, c.depressed, c.latched,
+				                      c.locked, 0, 0, 0);
+
+				for (unsigned k = 0; k < verify._printable.size(); ++k) {
+					if (!verify._main._selection.key(verify._printable[k].code))
+						continue;
+
+					Key_info key_info(state, keysym_cache, verify._printable[k].code);
+					if (!key_info.valid()) continue;
+
+					++result.checked;
+					result.reachable.insert(key_info.utf32());
+
+					unsigned const chargen = verify._chargen_lookup(s, k);
+
+					/* character depends on modifiers beyond mod1-mod4 */
+					Key_info expressible(chargen_state, keysym_cache, verify._printable[k].code);
+					if (expressible.utf32() != key_info.utf32()) {
+						result.inexpressible.push_back({ s, k, key_info.utf32(), chargen });
+						continue;
+					}
+
+					if (chargen != key_info.utf32())
+						result.mismatches.push_back({ s, k, key_info.utf32(), chargen });
+				}
+			}
+		}
+	};
+
+	Engine &_main;
+
+	Xkb::Keys const _printable { _main._model.printable };
+
+	/* maps of the generated config */
+	Chargen _chargen { };
+
+	std::vector<State> _states { };
+
+	/*
+	 * Modifier state of modifier key
+	 *
+	 * Lock and latch keys leave their modifiers locked resp. latched
+	 * after release, other keys are held down.
+	 */
+	Mod_state _key_mods(xkb_keycode_t keycode)
+	{
+		xkb_state *state = xkb_state_new(_main._keymap);
+
+		xkb_state_update_key(state, keycode, XKB_KEY_DOWN);
+		Mod_state const pressed(state);
+
+		xkb_state_update_key(state, keycode, XKB_KEY_UP);
+		Mod_state const released(state);
+
+		xkb_state_unref(state);
+
+		return released.effective() ? released : pressed;
+	}
+
+	/* bit mask of Xkb::modifier active in the modifier state */
+	unsigned _active(State state) const
+	{
+		unsigned active = 0;
+		for (unsigned i = 0; i < NUM_MODIFIERS; ++i) {
+			xkb_mod_mask_t const m = _main._modifier_mods[i].effective();
+			if (m && (state.effective() & m) == m) active |= 1u << i;
+		}
+		return active;
+	}
+
+	/*
+	 * Modifier state the config was generated for
+	 *
+	 * The state contains the modifiers of the active mod1-mod4 only.
+	 * Characters that differ from this state depend on modifiers the
+	 * chargen cannot express (e.g., Level5 or NumLock off).
+	 */
+	Mod_state _chargen_mods(State state) const
+	{
+		Mod_state result = _main._base_mods;
+
+		unsigned const active = _active(state);
+		for (unsigned i = 0; i < NUM_MODIFIERS; ++i) {
+			if (!(active & (1u << i))) continue;
+
+			Mod_state const &m = _main._modifier_mods[i];
+
+			result.depressed |= m.depressed;
+			result.latched   |= m.latched;
+			result.locked    |= m.locked;
+		}
+		return result;
+	}
+
+	/*
+	 * Character of key in the modifier state according to the chargen
+	 *
+	 * input_filter (chargen_source.h) considers the maps whose modifier
+	 * conditions are all fulfilled (a missing modN attribute is no
+	 * condition) and that define the key. Of these, the map with the
+	 * most conditions is used and the first one in the config on ties.
+	 */
+	unsigned _chargen_lookup(State state, unsigned key) const
+	{
+		unsigned const active = _active(state);
+
+		Chargen::Key const *result     = nullptr;
+		int                 conditions = -1;
+		for (Chargen::Map const &map : _chargen.maps) {
+			if ((active & map.specified) != map.mods) continue;
+
+			int const n = __builtin_popcount(map.specified);
+			if (n <= conditions) continue;
+
+			if (Chargen::Key const *k = map.key(_printable[key].code)) {
+				result     = k;
+				conditions = n;
+			}
+		}
+		return result ? result->value : 0;
+	}
+
+	void _collect_states()
+	{
+		struct Collector
+		{
+			Verify          &verify;
+			std::set<State>  key_mods { };
+		} collector { *this };
+
+		auto lambda = [] (xkb_keymap *, xkb_keycode_t keycode, void *data)
+		{
+			Collector &c = *reinterpret_cast<Collector *>(data);
+			Mod_state const mods = c.verify._key_mods(keycode);
+			if (mods.effective())
+				c.key_mods.insert({ mods });
+		};
+		xkb_keymap_key_for_each(_main._keymap, lambda, &collector);
+
+		/* all combinations of modifier keys */
+		std::set<State> states { State() };
+		for (State const &m : collector.key_mods) {
+			std::set<State> const current = states;
+			for (State s : current) {
+				s.mods.depressed |= m.mods.depressed;
+				s.mods.latched   |= m.mods.latched;
+				s.mods.locked    |= m.mods.locked;
+				states.insert(s);
+			}
+		}
+
+		_states.assign(states.begin(), states.end());
+	}
+
+	void _print_state(State state)
+	{
+		char buf[64] = { 0 };
+
+		for (xkb_mod_index_t i = 0; i < xkb_keymap_num_mods(_main._keymap); ++i) {
+			if (!(state.effective() & (1u << i))) continue;
+
+			if (buf[0]) strncat(buf, "+", sizeof(buf) - strlen(buf) - 1);
+			strncat(buf, xkb_keymap_mod_get_name(_main._keymap, i),
+			        sizeof(buf) - strlen(buf) - 1);
+			if (state.mods.locked & (1u << i))
+				strncat(buf, "(locked)", sizeof(buf) - strlen(buf) - 1);
+			else if (state.mods.latched & (1u << i))
+				strncat(buf, "(latched)", sizeof(buf) - strlen(buf) - 1);
+		}
+		_main._out.printf(" %-24s", buf[0] ? buf : "none");
+	}
+
+	void _print_char(char const *prefix, unsigned utf32)
+	{
+		char const *utf8 = utf32 > 0x1f
+		                 ? _main._keysym_cache->lookup(xkb_utf32_to_keysym(utf32)).utf8 : "";
+
+		_main._out.printf("  %s 0x%04x %-4s", prefix, utf32, utf8);
+	}
+
+	void _print_mismatch(Mismatch const &m)
+	{
+		_main._out.printf("%-16s", Input::key_name(_printable[m.key].code));
+		_print_state(m.state);
+		_print_char("xkb", m.xkb);
+		_print_char("chargen", m.chargen);
+		_main._out.printf("\n");
+	}
+
+	Verify(Engine &main) : _main(main)
+	{
+		Keysym_cache::Stats const keysym_stats = _main._keysym_cache->stats();
+
+		Expanding_xml_buffer xml_buffer;
+		xml_buffer.generate("chargen", [&] (Xml_generator &xml) {
+			_main._keysym_cache->discount(keysym_stats);
+			for (unsigned mods : Map::all())
+				if (_main._selection.map(mods)) { Map map { _main, xml, mods }; } });
+
+		_chargen = Chargen(xml_buffer.buffer(), strlen(xml_buffer.buffer()));
+
+		_collect_states();
+	}
+
+	int exec()
+	{
+		unsigned const num_workers =
+			std::max(1u, std::min(std::thread::hardware_concurrency(),
+			                      unsigned(_states.size())));
+
+		/* states are created up-front as keymap references are not thread safe */
+		std::vector<std::unique_ptr<Worker>> workers;
+		for (unsigned i = 0; i < num_workers; ++i)
+			workers.emplace_back(new Worker(*this, i, num_workers));
+
+		std::vector<std::thread> threads;
+		for (auto &w : workers)
+			threads.emplace_back([&w] () { w->run(); });
+		for (std::thread &t : threads) t.join();
+
+		Result              result;
+		Keysym_cache::Stats keysym_stats = _main._keysym_cache->stats();
+		for (auto &w : workers) {
+			keysym_stats += w->keysym_cache.stats();
+			result.checked += w->result.checked;
+			result.reachable.insert(w->result.reachable.begin(), w->result.reachable.end());
+			result.mismatches.insert(result.mismatches.end(),
+			                         w->result.mismatches.begin(), w->result.mismatches.end());
+			result.inexpressible.insert(result.inexpressible.end(),
+			                            w->result.inexpressible.begin(),
+			                            w->result.inexpressible.end());
+		}
+		std::sort(result.mismatches.begin(), result.mismatches.end(), _less);
+		std::sort(result.inexpressible.begin(), result.inexpressible.end(), _less);
+
+		unsigned long missing = 0;
+		for (Mismatch const &m : result.mismatches) {
+			if (!m.chargen) ++missing;
+			_print_mismatch(m);
+		}
+
+		if (!result.inexpressible.empty())
+			_main._out.printf("\nnot expressible with mod1-mod4 of chargen:\n");
+		for (Mismatch const &m : result.inexpressible)
+			_print_mismatch(m);
+
+		std::set<unsigned> producible;
+		for (Chargen::Map const &map : _chargen.maps)
+			for (Chargen::Key const &k : map.keys)
+				if (k.value) producible.insert(k.value);
+
+		std::vector<unsigned> unproducible;
+		for (unsigned utf32 : result.reachable)
+			if (!producible.count(utf32)) unproducible.push_back(utf32);
+
+		Sink &out = _main._out;
+
+		out.printf("\nchecked %lu key/modifier combinations in %zu modifier states using %u threads\n",
+		           result.checked, _states.size(), num_workers);
+		out.printf("  mismatches:  %zu (%lu without chargen character)\n",
+		           result.mismatches.size(), missing);
+		out.printf("  not expressible: %zu (not counted as mismatches)\n",
+		           result.inexpressible.size());
+		out.printf("  coverage:    %zu of %zu reachable characters producible, %zu missing\n",
+		           result.reachable.size() - unproducible.size(), result.reachable.size(),
+		           unproducible.size());
+		for (unsigned utf32 : unproducible) {
+			_print_char("missing", utf32);
+			out.printf("\n");
+		}
+
+		keysym_stats.print(_main._diag);
+
+		return result.mismatches.empty() ? 0 : 1;
+	}
+};
+
+
+char const * Engine::_string(enum xkb_compose_status status)
+{
+    switch (status) {
+    case XKB_COMPOSE_NOTHING:   return "XKB_COMPOSE_NOTHING";
+    case XKB_COMPOSE_COMPOSING: return "XKB_COMPOSE_COMPOSING";
+    case XKB_COMPOSE_COMPOSED:  return "XKB_COMPOSE_COMPOSED";
+    case XKB_COMPOSE_CANCELLED: return "XKB_COMPOSE_CANCELLED";
+    }
+    return "invalid";
+}
+
+
+char const * Engine::_string(enum xkb_compose_feed_result result)
+{
+    switch (result) {
+    case XKB_COMPOSE_FEED_IGNORED:  return "XKB_COMPOSE_FEED_IGNORED";
+    case XKB_COMPOSE_FEED_ACCEPTED: return "XKB_COMPOSE_FEED_ACCEPTED";
+    }
+    return "invalid";
+}
+
+
+void Engine::_keycode_info(xkb_keycode_t keycode)
+{
+	for (Xkb::Mapping const &m : _model.printable) {
+		if (m.xkb != keycode) continue;
+
+		_out.printf("keycode %3u:", m.xkb);
+		_out.printf(" %-8s", m.xkb_name);
+		_out.printf(" %-16s", Input::key_name(m.code));
+
+		xkb_layout_index_t const num_layouts = xkb_keymap_num_layouts_for_key(_keymap, m.xkb);
+
+		for (xkb_layout_index_t g = 0; g < num_layouts; ++g) {
+			if (g) _out.printf(" }\n%40s", "");
+
+			unsigned const num_levels = xkb_keymap_num_levels_for_key(_keymap, m.xkb, g);
+			_out.printf("\t%u levels { ", num_levels);
+
+			for (unsigned l = 0; l < num_levels; ++l) {
+				_out.printf(" %u:", l);
+
+				xkb_keysym_t const *syms = nullptr;
+				unsigned const num_syms = xkb_keymap_key_get_syms_by_level(_keymap, m.xkb, g, l, &syms);
+
+				for (unsigned s = 0; s < num_syms; ++s) {
+					Keysym_cache::Entry const &entry = _keysym_cache->lookup(syms[s]);
+					_out.printf(" %x %s", syms[s], entry.composing ? "COMPOSING!" : entry.utf8);
+				}
+			}
+		}
+
+		_out.printf(" }");
+		_out.printf("\n");
+		return;
+	}
+}
+
+
+void Engine::_keycode_xml_non_printable(Xml_generator &xml, xkb_keycode_t keycode)
+{
+	/* non-printable symbols with chargen entry (e.g., ENTER) */
+	for (Xkb::Mapping const &m : Xkb::non_printable) {
+		if (m.xkb != keycode) continue;
+		if (!_selection.key(m.code)) return;
+
+		xml.node("key", [&] ()
+		{
+			xml.attribute("name",  Input::key_name(m.code));
+			xml.attribute("ascii", m.ascii);
+		});
+
+		return;
+	}
+}
+
+
+void Engine::_keycode_xml_control(Xml_generator &xml, xkb_keycode_t keycode,
+                                  Map const &map)
+{
+	/* chargen entry for control characters (e.g., CTRL-J) */
+	static char const *desc[] {
+		"SOH (start of heading)    ",
+		"STX (start of text)       ",
+		"ETX (end of text)         ",
+		"EOT (end of transmission) ",
+		"ENQ (enquiry)             ",
+		"ACK (acknowledge)         ",
+		"BEL '\\a' (bell)           ",
+		"BS  '\\b' (backspace)      ",
+		"HT  '\\t' (horizontal tab) ",
+		"LF  '\\n' (new line)       ",
+		"VT  '\\v' (vertical tab)   ",
+		"FF  '\\f' (form feed)      ",
+		"CR  '\\r' (carriage ret)   ",
+		"SO  (shift out)           ",
+		"SI  (shift in)            ",
+		"DLE (data link escape)    ",
+		"DC1 (device control 1)    ",
+		"DC2 (device control 2)    ",
+		"DC3 (device control 3)    ",
+		"DC4 (device control 4)    ",
+		"NAK (negative ack.)       ",
+		"SYN (synchronous idle)    ",
+		"ETB (end of trans. blk)   ",
+		"CAN (cancel)              ",
+		"EM  (end of medium)       ",
+		"SUB (substitute)          ",
+		"ESC (escape)              ",
+		"FS  (file separator)      ",
+		"GS  (group separator)     ",
+		"RS  (record separator)    ",
+		"US  (unit separator)      ",
+	};
+	static char const *desc_del = "DEL (delete)              ";
+
+	bool const combined = Map::combined_control(map.mods);
+
+	for (Xkb::Mapping const &m : _model.printable) {
+		if (m.xkb != keycode) continue;
+		if (!_selection.key(m.code)) return;
+
+		xkb_keysym_t const keysym = xkb_state_key_get_one_sym(_state, keycode);
+		if (keysym == XKB_KEY_NoSymbol) return;
+
+		if (combined && !_combined_control_differs(m, map)) return;
+
+		unsigned const utf32 = xkb_state_key_get_utf32(_state, m.xkb);
+		if (!control_character(utf32)) {
+			if (!combined) return;
+
+			Key_info key_info(_state, *_keysym_cache, m.code);
+
+			xml.node("key", [&] ()
+			{
+				xml.attribute("name", Input::key_name(m.code));
+				key_info.attributes(xml);
+			});
+			key_info.comment(xml);
+
+			return;
+		}
+		char const *keysym_str = _keysym_cache->lookup(keysym).name;
+		char const *d          = utf32 == 0x7f ? desc_del : desc[utf32-1];
+
+		xml.node("key", [&] ()
+		{
+			xml.attribute("name", Input::key_name(m.code));
+			xml.attribute("code", Formatted("0x%04x", utf32).string());
+		});
+		append_comment(xml, "\t",
+		               Formatted("%s CTRL-%s", d, keysym_str).string(),
+		               "");
+
+		return;
+	}
+}
+
+
+void Engine::_keycode_xml_printable(Xml_generator &xml, xkb_keycode_t keycode)
+{
+	for (Xkb::Mapping const &m : _model.printable) {
+		if (m.xkb != keycode) continue;
+		if (!_selection.key(m.code)) return;
+
+		Key_info key_info(_state, *_keysym_cache, m.code);
+		if (key_info.unmapped())
+			_diag.printf("no UTF32 mapping found for composing keysym <%s>\n",
+			             _keysym_cache->lookup(key_info.keysym()).name);
+		if (!key_info.valid()) break;
+
+		xml.node("key", [&] ()
+		{
+			xml.attribute("name", Input::key_name(m.code));
+			key_info.attributes(xml);
+		});
+		key_info.comment(xml);
+
+		Keysym keysym { key_info.composing(), key_info.keysym(), key_info.utf32() };
+		_keysyms.insert(keysym);
+
+		return;
+	}
+}
+
+
+void Engine::_collect_keysyms()
+{
+	for (unsigned mods : Map::all()) {
+		if (Map::control(mods) && !Map::combined_control(mods)) continue;
+
+		_update_state(mods);
+
+		for (Xkb::Mapping const &m : _model.printable) {
+			Key_info key_info(_state, *_keysym_cache, m.code);
+			if (!key_info.valid()) continue;
+			if (control_character(key_info.utf32())) continue;
+
+			_keysyms.insert({ key_info.composing(), key_info.keysym(), key_info.utf32() });
+		}
+	}
+
+	_update_state(0);
+}
+
+
+/*
+ * Character of key in the current state of a combined control map
+ */
+unsigned Engine::_combined_control_utf32(Xkb::Mapping const &m)
+{
+	unsigned const utf32 = xkb_state_key_get_utf32(_state, m.xkb);
+	if (control_character(utf32)) return utf32;
+
+	Key_info key_info(_state, *_keysym_cache, m.code);
+
+	return key_info.valid() ? key_info.utf32() : 0;
+}
+
+
+/*
+ * Key of combined control map with character that differs from the fallback
+ */
+bool Engine::_combined_control_differs(Xkb::Mapping const &m, Map const &map)
+{
+	unsigned const utf32 = _combined_control_utf32(m);
+
+	return utf32 && utf32 != map.fallback.at(m.xkb);
+}
+
+
+/*
+ * Character of key in the control map or the basic map
+ *
+ * input_filter falls back to these maps if a combined control map does not
+ * define the key. The state must be updated by the caller afterwards.
+ */
+unsigned Engine::_control_fallback(Xkb::Mapping const &m, unsigned control_mods)
+{
+	_update_state(control_mods);
+
+	unsigned const utf32 = xkb_state_key_get_utf32(_state, m.xkb);
+	if (control_character(utf32)) return utf32;
+
+	_update_state(0);
+
+	return _combined_control_utf32(m);
+}
+
+
+void Engine::_update_state(unsigned mods)
+{
+	Mod_state state = _base_mods;
+
+	for (unsigned i = 0; i < NUM_MODIFIERS; ++i) {
+		if (!(mods & (1u << i))) continue;
+
+		Mod_state const &m = _modifier_mods[i];
+
+		state.depressed |= m.depressed;
+		state.latched   |= m.latched;
+		state.locked    |= m.locked;
+	}
+
+	xkb_state_update_mask(_state, state.depressed, state.latched, state.locked, 0, 0, 0);
+}
+
+
+/*
+ * Generate chargen config into buffer
+ *
+ * \return true if the sequence search exhausted its budget
+ */
+bool Engine::_generate_chargen(Expanding_xml_buffer &xml_buffer)
+{
+	Sequence::Budget const budget { _config.max_nodes, _config.max_time_ms };
+	Sequence::Stats        stats;
+
+	/* search sequences once, as the XML generation may be repeated */
+	Constructible<Sequence> sequence;
+	if (_selection.sequences()) {
+		_collect_keysyms();
+		sequence.construct(*this, budget, stats);
+	}
+
+	Keysym_cache::Stats const keysym_stats = _keysym_cache->stats();
+
+	auto generate_xml = [&] (Xml_generator &xml)
+	{
+		_keysym_cache->discount(keysym_stats);
+
+		for (unsigned mods : Map::all())
+			if (_selection.map(mods)) { Map map { *this, xml, mods }; }
+
+		if (sequence.constructed()) sequence->generate(xml);
+	};
+
+	xml_buffer.generate("chargen", generate_xml);
+
+	if (_selection.sequences()) stats.print(_diag);
+	_keysym_cache->stats().print(_diag);
+
+	return stats.exhausted;
+}
+
+
+/*
+ * Check that the minimal profile is well-formed, has the nodes of the
+ * config, and parses to the same chargen
+ */
+bool Engine::_check_minimal(char const *config, std::string const &minimal)
+{
+	if (!Config_text::same_nodes(config, minimal)) {
+		_diag.printf("profile: minimal config differs in nodes from the config\n");
+		return false;
+	}
+
+	try {
+		if (Chargen(minimal.c_str(), minimal.size()) == Chargen(config, strlen(config)))
+			return true;
+	} catch (Chargen::Invalid_config) { }
+
+	_diag.printf("profile: minimal config does not parse to the same chargen\n");
+	return false;
+}
+
+
+int Engine::generate()
+{
+	Expanding_xml_buffer xml_buffer;
+
+	bool const exhausted = _generate_chargen(xml_buffer);
+
+	char const * const config = xml_buffer.buffer();
+
+	if (_config.profile == Config::Profile::MINIMAL) {
+		std::string const minimal = Config_text::minimal(config, strlen(config));
+
+		if (!_check_minimal(config, minimal)) return 1;
+
+		_out.write(minimal.c_str(), minimal.size());
+
+		_diag.printf("profile: minimal config %zu bytes (annotated %zu bytes)\n",
+		             minimal.size(), strlen(config));
+
+		return exhausted ? 1 : 0;
+	}
+
+	_out.printf("<!-- %s/%s/%s chargen configuration generated by xkb2ifcfg -->\n",
+	            _config.layout, _config.variant, _config.locale);
+	_out.write(config, strlen(config));
+	_out.write("\n", 1);
+
+	return exhausted ? 1 : 0;
+}
+
+
+int Engine::size()
+{
+	Expanding_xml_buffer xml_buffer;
+
+	bool const exhausted = _generate_chargen(xml_buffer);
+
+	char const * const config = xml_buffer.buffer();
+
+	/* account the output of generate including the header comment */
+	Formatted const header("<!-- %s/%s/%s chargen configuration generated by xkb2ifcfg -->\n",
+	                       _config.layout, _config.variant, _config.locale);
+
+	Config_text::Size_report report;
+	report.add(header.string(), strlen(header.string()));
+	report.add(config, strlen(config));
+	report.add("\n", 1);
+
+	_out.printf("Size of %s/%s/%s chargen configuration in bytes\n\n",
+	            _config.layout, _config.variant, _config.locale);
+	report.print(_out);
+
+	bool const valid = _check_minimal(config, Config_text::minimal(config, strlen(config)));
+
+	return exhausted || !valid ? 1 : 0;
+}
+
+
+int Engine::delta(char const *previous)
+{
+	Chargen from;
+	try { from = Chargen(previous, strlen(previous)); }
+	catch (Chargen::Invalid_config) { throw Xkb2ifcfg::Invalid_config(); }
+
+	Expanding_xml_buffer config;
+
+	bool const exhausted = _generate_chargen(config);
+
+	Chargen const to(config.buffer(), strlen(config.buffer()));
+
+	Expanding_xml_buffer delta;
+	unsigned long changes = 0;
+	delta.generate("chargen_delta", [&] (Xml_generator &xml) {
+		changes = Chargen::generate_delta(xml, from, to); });
+
+	/* check that the delta reproduces the new config */
+	Chargen applied = from;
+	applied.apply_delta(delta.buffer(), strlen(delta.buffer()));
+	if (applied != to) {
+		_diag.printf("delta: delta does not reproduce the generated config\n");
+		return 1;
+	}
+
+	if (_config.profile == Config::Profile::MINIMAL) {
+		std::string const minimal = Config_text::minimal(delta.buffer(), strlen(delta.buffer()));
+
+		/* check that the minimal delta reproduces the new config as well */
+		bool valid = Config_text::same_nodes(delta.buffer(), minimal);
+		try {
+			Chargen applied_minimal = from;
+			applied_minimal.apply_delta(minimal.c_str(), minimal.size());
+			valid = valid && applied_minimal == to;
+		} catch (Chargen::Invalid_config) { valid = false; }
+
+		if (!valid) {
+			_diag.printf("profile: minimal delta does not reproduce the generated config\n");
+			return 1;
+		}
+
+		_out.write(minimal.c_str(), minimal.size());
+	} else {
+		_out.printf("<!-- %s/%s/%s chargen delta generated by xkb2ifcfg -->\n",
+		            _config.layout, _config.variant, _config.locale);
+		_out.write(delta.buffer(), strlen(delta.buffer()));
+		_out.write("\n", 1);
+	}
+
+	_diag.printf("delta: %lu changes in %zu bytes (config %zu bytes)\n",
+	             changes, strlen(delta.buffer()), strlen(config.buffer()));
+
+	return exhausted ? 1 : 0;
+}
+
+
+int Engine::dump()
+{
+	_out.printf("Dump of XKB keymap for %s/%s/%s by xkb2ifcfg\n",
+	            _config.layout, _config.variant, _config.locale);
+
+	char *text = xkb_keymap_get_as_string(_keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+	if (!text) return 1;
+
+	_out.write(text, strlen(text));
+	_out.write("\n", 1);
+	::free(text);
+
+	return 0;
+}
+
+
+int Engine::info()
+{
+	_out.printf("Simple per-key info for %s/%s/%s by xkb2ifcfg\n",
+	            _config.layout, _config.variant, _config.locale);
+
+	auto lambda = [] (xkb_keymap *, xkb_keycode_t keycode, void *data)
+	{
+		reinterpret_cast<Engine *>(data)->_keycode_info(keycode);
+	};
+
+	xkb_keymap_key_for_each(_keymap, lambda, this);
+
+	_keysym_cache->stats().print(_diag);
+
+	return 0;
+}
+
+
+int Engine::verify()
+{
+	_out.printf("Verification of %s/%s/%s chargen by xkb2ifcfg\n",
+	            _config.layout, _config.variant, _config.locale);
+
+	return Verify(*this).exec();
+}
+
+
+Xkb::Model const & Engine::_lookup_model(char const *name)
+{
+	Xkb::Model const *model = Xkb::lookup_model(name);
+	if (!model) throw Generator::Invalid_model();
+
+	return *model;
+}
+
+
+/*
+ * Call 'fn' for each item of comma-separated 'list'
+ */
+template <typename FUNC>
+static void for_each_item(char const *list, FUNC const &fn)
+{
+	if (!list) return;
+
+	for (char const *item = list; ; ++item) {
+		char const *end = ::strchr(item, ',');
+		size_t const len = end ? size_t(end - item) : ::strlen(item);
+
+		fn(std::string(item, len));
+
+		if (!end) break;
+		item = end;
+	}
+}
+
+
+Engine::Selection Engine::_select(Config const &config, Xkb::Model const &model)
+{
+	using Invalid_selector = Generator::Invalid_selector;
+
+	Selection result;
+
+	result.partial = config.maps || config.keys || config.dead;
+
+	for_each_item(config.maps, [&] (std::string const &name) {
+		bool found = false;
+		for (unsigned mods : Map::all()) {
+			if (name != (mods ? Map::Name(mods).string : "NONE")) continue;
+
+			result.maps.insert(mods);
+			found = true;
+		}
+		if (!found) throw Invalid_selector();
+	});
+
+	for_each_item(config.keys, [&] (std::string const &name) {
+		bool found = false;
+		for (Xkb::Keys keys : { model.printable, Xkb::Keys { Xkb::non_printable,
+		                        sizeof(Xkb::non_printable)/sizeof(Xkb::non_printable[0]) } }) {
+			for (Xkb::Mapping const &m : keys) {
+				if (name != Input::key_name(m.code)) continue;
+
+				result.keys.insert(m.code);
+				found = true;
+			}
+		}
+		if (!found) throw Invalid_selector();
+	});
+
+	for_each_item(config.dead, [&] (std::string const &name) {
+		xkb_keysym_t const keysym = xkb_keysym_from_name(name.c_str(), XKB_KEYSYM_NO_FLAGS);
+		if (keysym == XKB_KEY_NoSymbol) throw Invalid_selector();
+
+		result.dead.insert(keysym);
+	});
+
+	/* keys select from all maps unless maps are given explicitly */
+	if (!config.maps && config.keys)
+		for (unsigned mods : Map::all()) result.maps.insert(mods);
+
+	return result;
+}
+
+
+Engine::Engine(Config const &config, Sink &output, Sink &diag)
+:
+	_config(config), _out(output), _diag(diag), _model(_lookup_model(config.model)),
+	_selection(_select(config, _model))
+{
+	_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+	if (!_context) throw Generator::Keymap_failed();
+
+	_rmlvo  = { "evdev", _model.name, _config.layout, _config.variant, _config.options };
+	if (_config.keymap_text)
+		_keymap = xkb_keymap_new_from_string(_context, _config.keymap_text,
+		                                     XKB_KEYMAP_FORMAT_TEXT_V1,
+		                                     XKB_KEYMAP_COMPILE_NO_FLAGS);
+	else
+		_keymap = _config.cache_dir
+		        ? Keymap_cache(_config.cache_dir, _context, _rmlvo, _diag).keymap()
+		        : xkb_keymap_new_from_names(_context, &_rmlvo, XKB_KEYMAP_COMPILE_NO_FLAGS);
+	if (!_keymap) throw Generator::Keymap_failed();
+
+	/* input_filter has no notion of XKB groups (e.g., layout "us,de") */
+	if (num_groups() > 1) throw Generator::Invalid_group { num_groups() };
+
+	_compose_table = _config.compose_text
+	               ? xkb_compose_table_new_from_buffer(_context, _config.compose_text,
+	                                                   strlen(_config.compose_text),
+	                                                   _config.locale,
+	                                                   XKB_COMPOSE_FORMAT_TEXT_V1,
+	                                                   XKB_COMPOSE_COMPILE_NO_FLAGS)
+	               : xkb_compose_table_new_from_locale(_context, _config.locale,
+	                                                   XKB_COMPOSE_COMPILE_NO_FLAGS);
+	if (!_compose_table) throw Generator::Compose_failed();
+
+	_state         = xkb_state_new(_keymap);
+	_compose_state = xkb_compose_state_new(_compose_table, XKB_COMPOSE_STATE_NO_FLAGS);
+
+	_keysym_cache.construct(_compose_state);
+
+	/* selected first keysyms must start a sequence of the compose table */
+	for (xkb_keysym_t keysym : _selection.dead)
+		if (!_keysym_cache->lookup(keysym).composing)
+			throw Generator::Invalid_selector();
+
+	_numlock.construct(_state);
+	_base_mods = Mod_state(_state);
+
+	for (unsigned i = 0; i < NUM_MODIFIERS; ++i) {
+		Xkb::Modifier const &m = Xkb::modifier[i];
+
+		xkb_state *state = xkb_state_new(_keymap);
+
+		xkb_state_update_key(state, Xkb::keycode(m.code), XKB_KEY_DOWN);
+		if (m.emulation == Xkb::Modifier::Emulation::TAPPED)
+			xkb_state_update_key(state, Xkb::keycode(m.code), XKB_KEY_UP);
+
+		_modifier_mods[i] = Mod_state(state);
+
+		xkb_state_unref(state);
+	}
+
+	_update_state(0);
+}
+
+
+/*
+ * Library interface
+ */
+
+Xkb2ifcfg::Generator::Generator(Config const &config, Sink &output, Sink &diag)
+:
+	_engine(new Engine(config, output, diag))
+{ }
+
+
+Xkb2ifcfg::Generator::~Generator() { delete _engine; }
+
+
+int Xkb2ifcfg::Generator::generate() { return _engine->generate(); }
+int Xkb2ifcfg::Generator::delta(char const *previous) { return _engine->delta(previous); }
+int Xkb2ifcfg::Generator::size()     { return _engine->size(); }
+int Xkb2ifcfg::Generator::dump()     { return _engine->dump(); }
+int Xkb2ifcfg::Generator::info()     { return _engine->info(); }
+int Xkb2ifcfg::Generator::verify()   { return _engine->verify(); }
+
+
+int Xkb2ifcfg::apply_delta(char const *config, char const *delta,
+                           char const *expected, Sink &output, Sink &diag)
+{
+	try {
+		Chargen chargen(config, strlen(config));
+		chargen.apply_delta(delta, strlen(delta));
+
+		if (expected) {
+			if (chargen == Chargen(expected, strlen(expected))) return 0;
+
+			diag.printf("delta: result differs from expected config\n");
+			return 1;
+		}
+
+		Expanding_xml_buffer xml_buffer;
+		xml_buffer.generate("chargen", [&] (Xml_generator &xml) {
+			chargen.generate(xml); });
+
+		output.write(xml_buffer.buffer(), strlen(xml_buffer.buffer()));
+		output.write("\n", 1);
+
+		return 0;
+	} catch (Chargen::Invalid_config) { throw Xkb2ifcfg::Invalid_config(); }
+}
@@ -0,0 +1,296 @@
+/*
+ * \brief  Cache of compiled XKB keymaps
+ * \author Christian Helmuth <christian.helmuth@genode-labs.com>
+ * \date   2026-10-18
+ *
+ * Copyright (C) 2026 Genode Labs GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _KEYMAP_CACHE_H_
+#define _KEYMAP_CACHE_H_
+
+/* Linux includes */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <xkbcommon/xkbcommon.h>
+
+#include "util.h"
+#include "xkb2ifcfg.h"
+
+
+/*
+ * Serialized keymaps keyed by RMLVO and the XKB sources
+ *
+ * Resolving RMLVO names walks the rules file and parses many include
+ * files. The cache stores the keymap text of xkb_keymap_get_as_string()
+ * and loads it via xkb_keymap_new_from_buffer() over an mmap on later
+ * runs. As libxkbcommon does not tell which files were included on
+ * resolution (the sections of the keymap text are unnamed), the key
+ * covers the metadata (size, mtime) of all files and directories of the
+ * components of each include path. Thereby, any edit, addition, or
+ * removal of an XKB source file results in a new key. Walking the trees
+ * takes about a millisecond for the common XKB data, which is reported
+ * as source check.
+ */
+class Keymap_cache
+{
+	private:
+
+		using Clock = std::chrono::steady_clock;
+
+		xkb_context          *_context;
+		xkb_rule_names const &_rmlvo;
+		Xkb2ifcfg::Sink      &_diag;
+		Clock::time_point     _start { Clock::now() };
+		Formatted const       _path;
+		unsigned long const   _key_us { _us_since(_start) };
+
+		/*
+		 * Compile time of the keymap from RMLVO is appended to the cached
+		 * text as XKB comment
+		 */
+		static constexpr char const *_trailer = "\n// xkb2ifcfg compile time: %lu us\n";
+
+		struct Hash
+		{
+			uint64_t value { 0xcbf29ce484222325ull }; /* FNV-1a */
+
+			void add(void const *data, size_t len)
+			{
+				for (size_t i = 0; i < len; ++i) {
+					value ^= ((unsigned char const *)data)[i];
+					value *= 0x100000001b3ull;
+				}
+			}
+
+			void add(char const *s) { if (s) add(s, strlen(s) + 1); else add("", 1); }
+		};
+
+		/*
+		 * Add metadata of file or directory tree (nothing if it does not
+		 * exist)
+		 */
+		static void _hash_tree(Hash &h, std::string const &path)
+		{
+			struct stat st;
+			if (::stat(path.c_str(), &st) != 0) return;
+
+			h.add(path.c_str());
+			h.add(&st.st_size,  sizeof(st.st_size));
+			h.add(&st.st_mtim,  sizeof(st.st_mtim));
+
+			if (!S_ISDIR(st.st_mode)) return;
+
+			DIR *dir = ::opendir(path.c_str());
+			if (!dir) return;
+
+			std::vector<std::string> names;
+			while (dirent const *e = ::readdir(dir))
+				if (::strcmp(e->d_name, ".") && ::strcmp(e->d_name, ".."))
+					names.emplace_back(e->d_name);
+			::closedir(dir);
+
+			/* the order of readdir() is not defined */
+			std::sort(names.begin(), names.end());
+			for (std::string const &name : names)
+				_hash_tree(h, path + "/" + name);
+		}
+
+		static void _hash_sources(Hash &h, char const *path)
+		{
+			static char const *components[] = {
+				"rules", "keycodes", "types", "compat", "symbols" };
+
+			for (char const *c : components)
+				_hash_tree(h, std::string(path) + "/" + c);
+		}
+
+		static uint64_t _key(xkb_context *context, xkb_rule_names const &rmlvo)
+		{
+			Hash h;
+
+			h.add(rmlvo.rules); h.add(rmlvo.model); h.add(rmlvo.layout);
+			h.add(rmlvo.variant); h.add(rmlvo.options);
+
+			/* defaults for empty RMLVO fields */
+			char const *env[] = { "XKB_DEFAULT_RULES",   "XKB_DEFAULT_MODEL",
+			                      "XKB_DEFAULT_LAYOUT",  "XKB_DEFAULT_VARIANT",
+			                      "XKB_DEFAULT_OPTIONS" };
+			for (char const *e : env) h.add(::getenv(e));
+
+			for (unsigned i = 0; i < xkb_context_num_include_paths(context); ++i) {
+				char const *path = xkb_context_include_path_get(context, i);
+				h.add(path);
+
+				_hash_sources(h, path);
+			}
+
+			return h.value;
+		}
+
+		static unsigned long _us_since(Clock::time_point start)
+		{
+			return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+		}
+
+		/*
+		 * Load keymap from mmapped cache file
+		 *
+		 * \param compile_us  compile time recorded on caching
+		 */
+		xkb_keymap * _load(unsigned long &compile_us)
+		{
+			int const fd = ::open(_path.string(), O_RDONLY);
+			if (fd < 0) return nullptr;
+
+			xkb_keymap *keymap = nullptr;
+
+			struct stat st;
+			if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+				size_t const size = st.st_size;
+				void *addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+				if (addr != MAP_FAILED) {
+					char const *text = (char const *)addr;
+
+					keymap = xkb_keymap_new_from_buffer(_context, text, size,
+					                                    XKB_KEYMAP_FORMAT_TEXT_V1,
+					                                    XKB_KEYMAP_COMPILE_NO_FLAGS);
+
+					/* copy of the text tail is null-terminated for sscanf() */
+					char tail[64] { };
+					size_t const tail_len = size < sizeof(tail) ? size : sizeof(tail) - 1;
+					::memcpy(tail, text + size - tail_len, tail_len);
+
+					char const *trailer = ::strstr(tail, "// xkb2ifcfg");
+					if (!trailer || ::sscanf(trailer, _trailer + 1, &compile_us) != 1)
+						compile_us = 0;
+
+					::munmap(addr, size);
+				}
+			}
+			::close(fd);
+
+			return keymap;
+		}
+
+		void _store(xkb_keymap *keymap, unsigned long compile_us)
+		{
+			char *text = xkb_keymap_get_as_string(keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+			if (!text) return;
+
+			/*
+			 * Write to unique temporary file and rename for atomic update,
+			 * which is safe against concurrent generators in this and other
+			 * processes
+			 */
+			std::string tmp = std::string(_path.string()) + ".XXXXXX";
+
+			int const fd = ::mkstemp(&tmp[0]);
+			if (fd >= 0) {
+				if (FILE *file = ::fdopen(fd, "w")) {
+					::fchmod(fd, 0644);
+
+					bool const ok = ::fputs(text, file) >= 0
+					             && ::fprintf(file, _trailer, compile_us) > 0;
+
+					if (::fclose(file) == 0 && ok)
+						::rename(tmp.c_str(), _path.string());
+					else
+						::unlink(tmp.c_str());
+				} else {
+					::close(fd);
+					::unlink(tmp.c_str());
+				}
+			}
+
+			::free(text);
+		}
+
+	public:
+
+		Keymap_cache(char const *dir, xkb_context *context,
+		             xkb_rule_names const &rmlvo, Xkb2ifcfg::Sink &diag)
+		:
+			_context(context), _rmlvo(rmlvo), _diag(diag),
+			_path("%s/%016llx.xkb", dir, (unsigned long long)_key(context, rmlvo))
+		{
+			::mkdir(dir, 0755);
+		}
+
+		/*
+		 * Return keymap from cache or compile and cache it
+		 *
+		 * The timing of compilation with and without the cache is reported
+		 * to the diagnostics sink.
+		 */
+		xkb_keymap * keymap()
+		{
+			Clock::time_point const start = Clock::now();
+
+			unsigned long compile_us = 0;
+			if (xkb_keymap *keymap = _load(compile_us)) {
+				unsigned long const load_us = _us_since(start);
+
+				_diag.printf("keymap cache: hit %s, loaded in %lu us "
+				             "+ %lu us source check (compiled from RMLVO in %lu us)\n",
+				             _path.string(), load_us, _key_us, compile_us);
+				return keymap;
+			}
+
+			xkb_keymap *keymap = xkb_keymap_new_from_names(_context, &_rmlvo,
+			                                               XKB_KEYMAP_COMPILE_NO_FLAGS);
+			if (!keymap) return nullptr;
+
+			compile_us = _us_since(start);
+			_store(keymap, compile_us);
+
+			/* measure load of the cached keymap for comparison */
+			Clock::time_point const reload = Clock::now();
+			unsigned long unused = 0;
+			if (xkb_keymap *cached = _load(unused)) {
+				unsigned long const load_us = _us_since(reload);
+				xkb_keymap_unref(cached);
+
+				_diag.printf("keymap cache: miss %s, compiled from RMLVO in %lu us "
+				             "(loading from cache takes %lu us + %lu us source check)\n",
+				             _path.string(), compile_us, load_us, _key_us);
+			} else {
+				_diag.printf("keymap cache: miss %s, compiled from RMLVO in %lu us "
+				             "(caching failed)\n", _path.string(), compile_us);
+			}
+
+			return keymap;
+		}
+};
+
+#endif /* _KEYMAP_CACHE_H_ */
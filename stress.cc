@@ -0,0 +1,700 @@
+/*
+ * \brief  Stress test of the generator with synthetic keymaps and compose files
+ * \author Christian Helmuth <christian.helmuth@genode-labs.com>
+ * \date   2026-10-18
+ *
+ * Copyright (C) 2026 Genode Labs GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Linux includes */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <ctime>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "xkb2ifcfg.h"
+#include "xkb_mapping.h"
+#include "util.h"
+
+using Xkb2ifcfg::Sink;
+using Xkb2ifcfg::Generator;
+
+
+/*
+ * Sink discarding the output but counting its size
+ */
+struct Null_sink : Sink
+{
+	size_t bytes { 0 };
+
+	void write(char const *, size_t len) override { bytes += len; }
+};
+
+
+/*
+ * Pseudo-random numbers (xorshift64*) reproducible from the seed
+ */
+struct Random
+{
+	uint64_t _state;
+
+	Random(uint64_t seed) : _state((seed + 1) * 0x9e3779b97f4a7c15ull) { }
+
+	uint64_t next()
+	{
+		_state ^= _state >> 12;
+		_state ^= _state << 25;
+		_state ^= _state >> 27;
+		return _state * 0x2545f4914f6cdd1dull;
+	}
+
+	unsigned below(unsigned n) { return n ? unsigned(next() % n) : 0; }
+
+	bool chance(unsigned percent) { return below(100) < percent; }
+};
+
+
+/*
+ * Shape of a synthetic keymap and compose file
+ *
+ * The shape is drawn randomly per input and covers the dimensions that
+ * determine the generation time: the number of levels per key, the share
+ * of composing keysyms (dead keys and Multi_key) in the keymap, and the
+ * number, length, and nesting of compose sequences.
+ */
+struct Shape
+{
+	unsigned four_level_percent;   /* keys of type FOUR_LEVEL */
+	unsigned eight_level_percent;  /* keys of type EIGHT_LEVEL */
+	unsigned composing_percent;    /* composing keysyms on key levels */
+	unsigned unicode_percent;      /* non-Latin keysyms on key levels */
+	unsigned num_composing;        /* distinct composing keysyms */
+	unsigned num_sequences;
+	unsigned max_length;           /* of compose sequences */
+	unsigned nesting_percent;      /* sequences sharing a prefix */
+
+	Shape(Random &random)
+	:
+		four_level_percent (random.below(101)),
+		eight_level_percent(random.below(101 - four_level_percent)),
+		composing_percent  (random.below(40)),
+		unicode_percent    (random.below(50)),
+		num_composing      (1 + random.below(num_composing_keysyms())),
+		num_sequences      (random.below(4) ? random.below(5000) : random.below(50000)),
+		max_length         (2 + random.below(7)),
+		nesting_percent    (random.below(101))
+	{ }
+
+	static unsigned num_composing_keysyms()
+	{
+		return 1 + sizeof(Xkb::dead_keysym)/sizeof(Xkb::dead_keysym[0]);
+	}
+
+	static xkb_keysym_t composing_keysym(unsigned i)
+	{
+		return i == 0 ? XKB_KEY_Multi_key : Xkb::dead_keysym[i - 1].xkb;
+	}
+
+	void print(FILE *file) const
+	{
+		::fprintf(file, "levels 4:%u%% 8:%u%%, composing %u (%u%%), unicode %u%%, "
+		          "%u sequences (max length %u, nesting %u%%)",
+		          four_level_percent, eight_level_percent, num_composing,
+		          composing_percent, unicode_percent, num_sequences, max_length,
+		          nesting_percent);
+	}
+};
+
+
+/*
+ * Synthetic keymap and compose file
+ */
+class Synthetic_input
+{
+	private:
+
+		Random &_random;
+		Shape   _shape { _random };
+
+		/* keysyms on key levels, which continue compose sequences */
+		std::vector<xkb_keysym_t> _keysyms { };
+
+		std::string _name(xkb_keysym_t keysym)
+		{
+			char buf[64];
+			if (xkb_keysym_get_name(keysym, buf, sizeof(buf)) < 0)
+				return "NoSymbol";
+			return buf;
+		}
+
+		xkb_keysym_t _random_keysym()
+		{
+			if (_random.chance(_shape.composing_percent))
+				return Shape::composing_keysym(_random.below(_shape.num_composing));
+
+			if (_random.chance(_shape.unicode_percent)) {
+				static struct { unsigned first, count; } const range[] = {
+					{ 0x0370, 0x90 },  /* Greek */
+					{ 0x0400, 0x100 }, /* Cyrillic */
+					{ 0x1e00, 0x100 }, /* Latin extended additional */
+					{ 0x4e00, 0x200 }, /* CJK */
+				};
+				auto const &r = range[_random.below(sizeof(range)/sizeof(range[0]))];
+				return 0x1000000 + r.first + _random.below(r.count);
+			}
+
+			if (_random.chance(5))  return XKB_KEY_NoSymbol;
+			if (_random.chance(30)) return 0xa0 + _random.below(0x60);  /* Latin-1 */
+
+			return 0x21 + _random.below(0x5e);  /* ASCII */
+		}
+
+		void _keymap()
+		{
+			keymap += "xkb_keymap {\n"
+			          "xkb_keycodes \"fuzz\" {\n"
+			          "\tminimum = 8;\n"
+			          "\tmaximum = 255;\n"
+			          "\t<LFSH> = 50;\n"
+			          "\t<LCTL> = 37;\n"
+			          "\t<RALT> = 108;\n"
+			          "\t<RCTL> = 105;\n"
+			          "\t<CAPS> = 66;\n"
+			          "\t<NMLK> = 77;\n";
+
+			for (Xkb::Mapping const &m : Xkb::non_printable)
+				keymap += Formatted("\t%s = %u;\n", m.xkb_name, m.xkb).string();
+			for (Xkb::Mapping const &m : Xkb::printable)
+				keymap += Formatted("\t%s = %u;\n", m.xkb_name, m.xkb).string();
+
+			keymap += "};\n"
+			          "xkb_types \"fuzz\" {\n"
+			          "\tvirtual_modifiers NumLock,LevelThree,LevelFive;\n"
+			          "\ttype \"ONE_LEVEL\" {\n"
+			          "\t\tmodifiers = none;\n"
+			          "\t\tlevel_name[Level1] = \"Any\";\n"
+			          "\t};\n"
+			          "\ttype \"TWO_LEVEL\" {\n"
+			          "\t\tmodifiers = Shift;\n"
+			          "\t\tmap[Shift] = Level2;\n"
+			          "\t\tlevel_name[Level1] = \"Base\";\n"
+			          "\t\tlevel_name[Level2] = \"Shift\";\n"
+			          "\t};\n"
+			          "\ttype \"ALPHABETIC\" {\n"
+			          "\t\tmodifiers = Shift+Lock;\n"
+			          "\t\tmap[Shift] = Level2;\n"
+			          "\t\tmap[Lock] = Level2;\n"
+			          "\t\tlevel_name[Level1] = \"Base\";\n"
+			          "\t\tlevel_name[Level2] = \"Caps\";\n"
+			          "\t};\n"
+			          "\ttype \"FOUR_LEVEL\" {\n"
+			          "\t\tmodifiers = Shift+LevelThree;\n"
+			          "\t\tmap[Shift] = Level2;\n"
+			          "\t\tmap[LevelThree] = Level3;\n"
+			          "\t\tmap[Shift+LevelThree] = Level4;\n"
+			          "\t\tlevel_name[Level1] = \"Base\";\n"
+			          "\t\tlevel_name[Level2] = \"Shift\";\n"
+			          "\t\tlevel_name[Level3] = \"Alt Base\";\n"
+			          "\t\tlevel_name[Level4] = \"Shift Alt\";\n"
+			          "\t};\n"
+			          "\ttype \"EIGHT_LEVEL\" {\n"
+			          "\t\tmodifiers = Shift+Lock+LevelThree+LevelFive;\n"
+			          "\t\tmap[Shift] = Level2;\n"
+			          "\t\tmap[Lock] = Level2;\n"
+			          "\t\tmap[LevelThree] = Level3;\n"
+			          "\t\tmap[Shift+LevelThree] = Level4;\n"
+			          "\t\tmap[LevelFive] = Level5;\n"
+			          "\t\tmap[Shift+LevelFive] = Level6;\n"
+			          "\t\tmap[LevelThree+LevelFive] = Level7;\n"
+			          "\t\tmap[Shift+LevelThree+LevelFive] = Level8;\n"
+			          "\t\tpreserve[Lock] = Lock;\n"
+			          "\t\tlevel_name[Level1] = \"Base\";\n"
+			          "\t\tlevel_name[Level2] = \"Shift\";\n"
+			          "\t\tlevel_name[Level3] = \"Alt Base\";\n"
+			          "\t\tlevel_name[Level4] = \"Shift Alt\";\n"
+			          "\t\tlevel_name[Level5] = \"X\";\n"
+			          "\t\tlevel_name[Level6] = \"X Shift\";\n"
+			          "\t\tlevel_name[Level7] = \"X Alt Base\";\n"
+			          "\t\tlevel_name[Level8] = \"X Shift Alt\";\n"
+			          "\t};\n"
+			          "};\n"
+			          "xkb_compat \"fuzz\" {\n"
+			          "\tvirtual_modifiers NumLock,LevelThree,LevelFive;\n"
+			          "\tinterpret.useModMapMods = AnyLevel;\n"
+			          "\tinterpret.repeat = False;\n"
+			          "\tinterpret ISO_Level3_Shift+AnyOf(all) {\n"
+			          "\t\tvirtualModifier = LevelThree;\n"
+			          "\t\tuseModMapMods = level1;\n"
+			          "\t\taction = SetMods(modifiers=LevelThree,clearLocks);\n"
+			          "\t};\n"
+			          "\tinterpret ISO_Level3_Latch+AnyOf(all) {\n"
+			          "\t\tvirtualModifier = LevelThree;\n"
+			          "\t\tuseModMapMods = level1;\n"
+			          "\t\taction = LatchMods(modifiers=LevelThree,clearLocks,latchToLock);\n"
+			          "\t};\n"
+			          "\tinterpret ISO_Level3_Lock+AnyOf(all) {\n"
+			          "\t\tvirtualModifier = LevelThree;\n"
+			          "\t\tuseModMapMods = level1;\n"
+			          "\t\taction = LockMods(modifiers=LevelThree);\n"
+			          "\t};\n"
+			          "\tinterpret ISO_Level5_Shift+AnyOf(all) {\n"
+			          "\t\tvirtualModifier = LevelFive;\n"
+			          "\t\tuseModMapMods = level1;\n"
+			          "\t\taction = SetMods(modifiers=LevelFive,clearLocks);\n"
+			          "\t};\n"
+			          "\tinterpret Num_Lock+AnyOf(all) {\n"
+			          "\t\tvirtualModifier = NumLock;\n"
+			          "\t\taction = LockMods(modifiers=NumLock);\n"
+			          "\t};\n"
+			          "\tinterpret Caps_Lock+AnyOfOrNone(all) {\n"
+			          "\t\taction = LockMods(modifiers=Lock);\n"
+			          "\t};\n"
+			          "\tinterpret Shift_Lock+AnyOf(Shift+Lock) {\n"
+			          "\t\taction = LockMods(modifiers=Shift);\n"
+			          "\t};\n"
+			          "\tinterpret Any+Exactly(Lock) {\n"
+			          "\t\taction = LockMods(modifiers=Lock);\n"
+			          "\t};\n"
+			          "\tinterpret Any+AnyOf(all) {\n"
+			          "\t\taction = SetMods(modifiers=modMapMods,clearLocks);\n"
+			          "\t};\n"
+			          "};\n";
+
+			/* unusual level layouts via the keysyms of AltGr and CapsLock */
+			static char const *altgr[] = {
+				"ISO_Level3_Shift", "ISO_Level3_Latch", "ISO_Level3_Lock", "ISO_Level5_Shift" };
+			static char const *capslock[] = {
+				"Caps_Lock", "Shift_Lock", "ISO_Level3_Lock", "ISO_Level5_Shift" };
+
+			keymap += Formatted("xkb_symbols \"fuzz\" {\n"
+			                    "\tname[Group1] = \"Fuzz\";\n"
+			                    "\tkey <LFSH> { [ Shift_L ] };\n"
+			                    "\tkey <LCTL> { [ Control_L ] };\n"
+			                    "\tkey <RALT> { type = \"ONE_LEVEL\", [ %s ] };\n"
+			                    "\tkey <RCTL> { type = \"ONE_LEVEL\", [ ISO_Level5_Shift ] };\n"
+			                    "\tkey <CAPS> { type = \"ONE_LEVEL\", [ %s ] };\n"
+			                    "\tkey <NMLK> { [ Num_Lock ] };\n",
+			                    altgr[_random.below(4)], capslock[_random.below(4)]).string();
+
+			for (Xkb::Mapping const &m : Xkb::non_printable) {
+				char buf[64];
+				xkb_keysym_get_name(xkb_utf32_to_keysym(m.ascii == 10 ? 13 : m.ascii),
+				                    buf, sizeof(buf));
+				keymap += Formatted("\tkey %s { [ %s ] };\n", m.xkb_name, buf).string();
+			}
+
+			for (Xkb::Mapping const &m : Xkb::printable) {
+				unsigned const percent = _random.below(100);
+
+				char const *type   = "TWO_LEVEL";
+				unsigned    levels = 2;
+
+				if (percent < _shape.eight_level_percent) {
+					type = "EIGHT_LEVEL"; levels = 8;
+				} else if (percent < _shape.eight_level_percent + _shape.four_level_percent) {
+					type = "FOUR_LEVEL"; levels = 4;
+				} else if (_random.chance(10)) {
+					type = "ONE_LEVEL"; levels = 1;
+				} else if (_random.chance(50)) {
+					type = "ALPHABETIC";
+				}
+
+				keymap += Formatted("\tkey %s { type = \"%s\", [", m.xkb_name, type).string();
+				for (unsigned i = 0; i < levels; ++i) {
+					xkb_keysym_t const keysym = _random_keysym();
+					keymap += (i ? ", " : " ") + _name(keysym);
+
+					if (keysym != XKB_KEY_NoSymbol) _keysyms.push_back(keysym);
+				}
+				keymap += " ] };\n";
+			}
+
+			keymap += "\tmodifier_map Shift   { <LFSH> };\n"
+			          "\tmodifier_map Lock    { <CAPS> };\n"
+			          "\tmodifier_map Control { <LCTL> };\n"
+			          "\tmodifier_map Mod2    { <NMLK> };\n"
+			          "\tmodifier_map Mod3    { <RCTL> };\n"
+			          "\tmodifier_map Mod5    { <RALT> };\n"
+			          "};\n"
+			          "};\n";
+		}
+
+		void _compose()
+		{
+			if (_keysyms.empty()) _keysyms.push_back(XKB_KEY_a);
+
+			std::vector<std::vector<xkb_keysym_t>> sequences;
+
+			for (unsigned i = 0; i < _shape.num_sequences; ++i) {
+				std::vector<xkb_keysym_t> seq;
+
+				/* nested sequences continue a prefix of a previous sequence */
+				if (!sequences.empty() && _random.chance(_shape.nesting_percent)) {
+					std::vector<xkb_keysym_t> const &prev =
+						sequences[_random.below(unsigned(sequences.size()))];
+					seq.assign(prev.begin(), prev.begin() + 1 + _random.below(unsigned(prev.size())));
+				} else {
+					seq.push_back(Shape::composing_keysym(_random.below(_shape.num_composing)));
+				}
+
+				unsigned const length = 2 + _random.below(_shape.max_length - 1);
+				while (seq.size() < length) {
+					xkb_keysym_t const keysym = _random.chance(90)
+						? _keysyms[_random.below(unsigned(_keysyms.size()))]
+						: _random_keysym();
+
+					if (keysym != XKB_KEY_NoSymbol) seq.push_back(keysym);
+				}
+
+				/* result is a character of the Latin-1 supplement or beyond */
+				unsigned const utf32 = 0xa0 + _random.below(0x2000);
+				char utf8[8] { };
+				xkb_keysym_to_utf8(0x1000000 + utf32, utf8, sizeof(utf8));
+
+				for (xkb_keysym_t keysym : seq)
+					compose += "<" + _name(keysym) + "> ";
+				compose += Formatted(": \"%s\" U%04X\n", utf8, utf32).string();
+
+				sequences.push_back(seq);
+			}
+		}
+
+	public:
+
+		std::string keymap  { };
+		std::string compose { };
+
+		Synthetic_input(Random &random) : _random(random) { _keymap(); _compose(); }
+
+		Shape const & shape() const { return _shape; }
+};
+
+
+/*
+ * Generation run in a child process
+ */
+struct Run
+{
+	enum class Status { OK, EXHAUSTED, INVALID, TIMEOUT, CRASHED };
+
+	Status        status  { Status::CRASHED };
+	int           signal  { 0 };
+	unsigned long cpu_ms  { 0 };
+	unsigned long wall_ms { 0 };
+	long          rss_kib { 0 };
+
+	char const * string() const
+	{
+		switch (status) {
+		case Status::OK:        return "ok";
+		case Status::EXHAUSTED: return "budget exhausted";
+		case Status::INVALID:   return "invalid input";
+		case Status::TIMEOUT:   return "timeout";
+		case Status::CRASHED:   return "crashed";
+		}
+		return "";
+	}
+
+	/*
+	 * Generate config in child process
+	 *
+	 * The child is killed after 'timeout_ms' of wall-clock time. CPU time
+	 * and peak RSS are taken from the resource usage of the child.
+	 */
+	Run(Xkb2ifcfg::Config const &config, unsigned long timeout_ms)
+	{
+		using Clock = std::chrono::steady_clock;
+
+		Clock::time_point const start = Clock::now();
+
+		pid_t const pid = ::fork();
+		if (pid < 0) { ::perror("fork"); ::exit(-1); }
+
+		if (pid == 0) {
+			/* silence libxkbcommon warnings about synthetic input */
+			int const null = ::open("/dev/null", O_WRONLY);
+			if (null >= 0) ::dup2(null, 2);
+
+			Null_sink out, diag;
+
+			int result = 2;
+			try { result = Generator(config, out, diag).generate(); }
+			catch (Generator::Keymap_failed)  { }
+			catch (Generator::Compose_failed) { }
+
+			::_exit(result);
+		}
+
+		auto elapsed_ms = [&] () {
+			return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(
+				Clock::now() - start).count(); };
+
+		int    wstatus = 0;
+		rusage usage { };
+		bool   killed  = false;
+
+		while (::wait4(pid, &wstatus, WNOHANG, &usage) == 0) {
+			if (!killed && elapsed_ms() > timeout_ms) {
+				::kill(pid, SIGKILL);
+				killed = true;
+			}
+			::usleep(1000);
+		}
+
+		wall_ms = elapsed_ms();
+		cpu_ms  = (usage.ru_utime.tv_sec  + usage.ru_stime.tv_sec) * 1000
+		        + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+		rss_kib = usage.ru_maxrss;
+
+		if (killed) {
+			status = Status::TIMEOUT;
+		} else if (WIFSIGNALED(wstatus)) {
+			status = Status::CRASHED;
+			signal = WTERMSIG(wstatus);
+		} else switch (WEXITSTATUS(wstatus)) {
+			case 0:  status = Status::OK;        break;
+			case 1:  status = Status::EXHAUSTED; break;
+			case 2:  status = Status::INVALID;   break;
+			default: status = Status::CRASHED;   break;
+		}
+	}
+};
+
+
+struct Args
+{
+	struct Invalid_args { };
+
+	unsigned long iterations { 100 };
+	unsigned long seed       { (unsigned long)::time(nullptr) };
+	unsigned long timeout_ms { 10000 };
+	char const   *corpus     { "corpus" };
+	char const   *locale     { "en_US.UTF-8" };
+
+	Xkb2ifcfg::Config config { "fuzz", "", locale };
+
+	char const *usage =
+		"usage: xkb2ifcfg_stress [options]\n"
+		"\n"
+		"  Generates configs from synthetic keymaps and compose files and\n"
+		"  keeps inputs that set new worst-case runtime or memory records,\n"
+		"  time out, or crash in the corpus directory. The records are kept\n"
+		"  in <corpus>/records as baseline of later runs.\n"
+		"\n"
+		"  Options\n"
+		"\n"
+		"    --iterations=<n>  number of inputs (default: 100)\n"
+		"    --seed=<n>        seed of first input (default: time)\n"
+		"    --max-nodes=<n>   node budget of the sequence search\n"
+		"                      (default: 1000000)\n"
+		"    --max-time=<ms>   time budget of the sequence search\n"
+		"                      (default: 1000)\n"
+		"    --timeout=<ms>    kill generation after timeout (default: 10000)\n"
+		"    --corpus=<dir>    directory of kept inputs (default: corpus)\n"
+		"    --model=<model>   keyboard model (default: pc105)\n"
+		"\n"
+		"  Example\n"
+		"\n"
+		"    xkb2ifcfg_stress --iterations=1000 --seed=1 --max-time=500\n"
+		"    xkb2ifcfg --keymap=corpus/42.xkb --compose=corpus/42.compose \\\n"
+		"              generate fuzz '' en_US.UTF-8\n";
+
+	static char const * _option(char const *arg, char const *name)
+	{
+		size_t const len = strlen(name);
+
+		if (::strncmp(arg, "--", 2) || ::strncmp(arg + 2, name, len) || arg[len + 2] != '=')
+			return nullptr;
+
+		return arg + len + 3;
+	}
+
+	static unsigned long _number(char const *value)
+	{
+		char *end = nullptr;
+		unsigned long const result = ::strtoul(value, &end, 10);
+
+		if (!*value || *end) throw Invalid_args();
+
+		return result;
+	}
+
+	Args(int argc, char **argv)
+	try {
+		config.max_nodes   = 1000000;
+		config.max_time_ms = 1000;
+
+		for (int i = 1; i < argc; ++i) {
+			if (char const *value = _option(argv[i], "iterations")) {
+				iterations = _number(value);
+			} else if (char const *value = _option(argv[i], "seed")) {
+				seed = _number(value);
+			} else if (char const *value = _option(argv[i], "max-nodes")) {
+				config.max_nodes = _number(value);
+			} else if (char const *value = _option(argv[i], "max-time")) {
+				config.max_time_ms = _number(value);
+			} else if (char const *value = _option(argv[i], "timeout")) {
+				timeout_ms = _number(value);
+			} else if (char const *value = _option(argv[i], "corpus")) {
+				if (!strlen(value)) throw Invalid_args();
+				corpus = value;
+			} else if (char const *value = _option(argv[i], "model")) {
+				if (!strlen(value)) throw Invalid_args();
+				config.model = value;
+			} else {
+				throw Invalid_args();
+			}
+		}
+
+		if (!Xkb::lookup_model(config.model)) throw Invalid_args();
+	} catch (...) { ::fputs(usage, stderr); throw; }
+};
+
+
+static bool write_file(char const *path, std::string const &content)
+{
+	FILE *file = ::fopen(path, "w");
+	if (!file) return false;
+
+	bool const ok = ::fwrite(content.data(), 1, content.size(), file) == content.size();
+
+	return ::fclose(file) == 0 && ok;
+}
+
+
+/*
+ * Worst-case records of all runs on the corpus
+ *
+ * The records are kept in <corpus>/records, so inputs of later runs are
+ * kept only if they exceed the worst case of all earlier runs.
+ */
+struct Records
+{
+	std::string const path;
+
+	unsigned long cpu_ms  { 0 };
+	long          rss_kib { 0 };
+
+	Records(char const *corpus) : path(std::string(corpus) + "/records")
+	{
+		FILE *file = ::fopen(path.c_str(), "r");
+		if (!file) return;
+
+		if (::fscanf(file, "cpu_ms %lu rss_kib %ld", &cpu_ms, &rss_kib) != 2) {
+			cpu_ms  = 0;
+			rss_kib = 0;
+		}
+		::fclose(file);
+	}
+
+	bool write() const
+	{
+		return write_file(path.c_str(), Formatted("cpu_ms %lu\nrss_kib %ld\n",
+		                                          cpu_ms, rss_kib).string());
+	}
+};
+
+
+int main(int argc, char **argv)
+{
+	try {
+		Args const args(argc, argv);
+
+		::mkdir(args.corpus, 0755);
+
+		/* worst cases of earlier runs and so far */
+		Records const baseline(args.corpus);
+		Records       records(args.corpus);
+
+		unsigned long exhausted = 0, invalid = 0, kept = 0, failed = 0;
+
+		for (unsigned long i = 0; i < args.iterations; ++i) {
+			unsigned long const seed = args.seed + i;
+
+			Random random(seed);
+			Synthetic_input const input(random);
+
+			Xkb2ifcfg::Config config = args.config;
+			config.keymap_text  = input.keymap.c_str();
+			config.compose_text = input.compose.c_str();
+
+			Run const run(config, args.timeout_ms);
+
+			if (run.status == Run::Status::EXHAUSTED) ++exhausted;
+			if (run.status == Run::Status::INVALID)   ++invalid;
+
+			bool const failure = run.status == Run::Status::TIMEOUT
+			                  || run.status == Run::Status::CRASHED;
+			bool const cpu     = run.cpu_ms  > records.cpu_ms;
+			bool const rss     = run.rss_kib > records.rss_kib;
+
+			if (run.status == Run::Status::INVALID || !(failure || cpu || rss))
+				continue;
+
+			if (cpu) records.cpu_ms  = run.cpu_ms;
+			if (rss) records.rss_kib = run.rss_kib;
+			if (failure) ++failed;
+
+			Formatted const keymap ("%s/%lu.xkb",     args.corpus, seed);
+			Formatted const compose("%s/%lu.compose", args.corpus, seed);
+
+			bool const saved = write_file(keymap.string(),  input.keymap)
+			                && write_file(compose.string(), input.compose);
+			if (saved) ++kept;
+
+			::printf("seed %lu: %s", seed, run.string());
+			if (run.signal) ::printf(" (signal %d)", run.signal);
+			::printf(", %lu ms cpu, %lu ms wall, %ld KiB rss%s%s%s -- ",
+			         run.cpu_ms, run.wall_ms, run.rss_kib,
+			         cpu ? ", time record" : "", rss ? ", memory record" : "",
+			         saved ? "" : ", saving failed");
+			input.shape().print(stdout);
+			::printf("\n");
+			::fflush(stdout);
+		}
+
+		::printf("%lu inputs, %lu budget exhausted, %lu invalid, %lu timeouts or "
+		         "crashes, worst case %lu ms cpu and %ld KiB rss, %lu kept in %s\n",
+		         args.iterations, exhausted, invalid, failed, records.cpu_ms,
+		         records.rss_kib, kept, args.corpus);
+
+		if (records.cpu_ms > baseline.cpu_ms || records.rss_kib > baseline.rss_kib) {
+			::printf("records exceed baseline of %lu ms cpu and %ld KiB rss%s\n",
+			         baseline.cpu_ms, baseline.rss_kib,
+			         records.write() ? "" : ", updating records failed");
+		}
+
+		return failed ? 1 : 0;
+
+	} catch (...) { }
+
+	return -1;
+}
@@ -30,6 +30,10 @@
 /* Linux includes */
 #include <cstdio>
 #include <cstdlib>
+#include <cstdarg>
+#include <string>
+
+#include "xkb2ifcfg.h"
 
 
 struct Formatted
@@ -58,4 +62,14 @@ struct Formatted
 };
 
 
+/*
+ * Sink that collects the output in a string
+ */
+struct String_sink : Xkb2ifcfg::Sink
+{
+	std::string data { };
+
+	void write(char const *str, size_t len) override { data.append(str, len); }
+};
+
 #endif /* _UTIL_H_ */
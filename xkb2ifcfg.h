@@ -0,0 +1,257 @@
+/*
+ * \brief  Libxkbcommon-based keyboard-layout generator library
+ * \author Christian Helmuth <christian.helmuth@genode-labs.com>
+ * \date   2026-10-18
+ *
+ * Copyright (C) 2026 Genode Labs GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _XKB2IFCFG_H_
+#define _XKB2IFCFG_H_
+
+/* Linux includes */
+#include <cstddef>
+
+
+namespace Xkb2ifcfg {
+
+	struct Sink;
+	struct Config;
+	class  Engine;
+	class  Generator;
+	class  Bundle;
+
+	/* malformed chargen config or delta document */
+	struct Invalid_config { };
+
+	/*
+	 * Apply delta document to chargen config
+	 *
+	 * \param expected  if not nullptr, the result is compared to this
+	 *                  config instead of written to 'output'
+	 *
+	 * \throw  Invalid_config
+	 * \return 0 on success, 1 if the result differs from 'expected'
+	 */
+	int apply_delta(char const *config, char const *delta,
+	                char const *expected, Sink &output, Sink &diag);
+}
+
+
+/*
+ * Destination of generated output and diagnostics
+ *
+ * The sink of diagnostics may be called from worker threads of the verify
+ * command concurrently.
+ */
+struct Xkb2ifcfg::Sink
+{
+	virtual ~Sink() { }
+
+	virtual void write(char const *str, size_t len) = 0;
+
+	void printf(char const *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+
+struct Xkb2ifcfg::Config
+{
+	char const *layout;
+	char const *variant;
+	char const *locale;
+
+	char const *model   { "pc105" }; /* pc104, pc105, jp106, abnt2, kinesis */
+	char const *options { "" };
+
+	/* budget of the dead-key / compose sequence search (0 means unlimited) */
+	unsigned long max_nodes   { 0 };
+	unsigned long max_time_ms { 0 };
+
+	/* directory of compiled-keymap cache (nullptr if disabled) */
+	char const *cache_dir { nullptr };
+
+	/*
+	 * Selectors of partial generation (comma-separated lists)
+	 *
+	 * Without selectors the complete config is generated. Otherwise, only
+	 * the selected maps (e.g., "NONE,SHIFT,SHIFT-ALTGR") are generated,
+	 * restricted to the selected keys (e.g., "KEY_Q,KEY_A"). If keys but no
+	 * maps are selected, all maps are generated. Sequences are generated
+	 * only if first keysyms (e.g., "dead_acute") are selected, which must
+	 * start a sequence of the compose table.
+	 */
+	char const *maps { nullptr };
+	char const *keys { nullptr };
+	char const *dead { nullptr };
+
+	/*
+	 * Keymap and compose table in XKB text format, which replace the
+	 * keymap of layout/variant/model resp. the compose table of the
+	 * locale if not nullptr
+	 */
+	char const *keymap_text  { nullptr };
+	char const *compose_text { nullptr };
+
+	/*
+	 * Output profile of generate and delta
+	 *
+	 * The minimal profile omits comments, <dummy/> nodes, and indentation
+	 * for targets with tight storage.
+	 */
+	enum class Profile { ANNOTATED, MINIMAL };
+
+	Profile profile { Profile::ANNOTATED };
+};
+
+
+/*
+ * Generator of input_filter chargen configurations
+ *
+ * Each generator owns its XKB context, keymap, and compose table. Hence,
+ * many generators may exist (and be used in different threads) in one
+ * process. The generator copies the strings of the config, which need
+ * not outlive the constructor. Concurrent generators may share a cache
+ * directory.
+ */
+class Xkb2ifcfg::Generator
+{
+	private:
+
+		Engine *_engine;
+
+		Generator(Generator const &) = delete;
+		Generator & operator = (Generator const &) = delete;
+
+	public:
+
+		struct Invalid_model     { };
+		struct Keymap_failed     { };
+		struct Compose_failed    { };
+		struct Invalid_selector  { };
+		struct Invalid_group     { unsigned num_groups; };
+
+		/*
+		 * Constructor
+		 *
+		 * \param output  sink for generated output
+		 * \param diag    sink for diagnostics
+		 *
+		 * \throw Invalid_model   unknown keyboard model
+		 * \throw Keymap_failed   keymap compilation failed
+		 * \throw Compose_failed  compose table for locale not available or
+		 *                        compose text malformed
+		 * \throw Invalid_selector unknown map, key, or keysym in selectors
+		 * \throw Invalid_group    keymap has multiple XKB groups, which
+		 *                         input_filter cannot express
+		 */
+		Generator(Config const &config, Sink &output, Sink &diag);
+
+		~Generator();
+
+		/*
+		 * Commands return 0 on success
+		 */
+		int generate();  /* generate input_filter config */
+
+		/*
+		 * Generate delta document against previous config
+		 *
+		 * The delta contains the maps, keys, and sequences that changed
+		 * compared to 'previous' (see chargen.h).
+		 *
+		 * \throw Invalid_config  'previous' is not a chargen config
+		 */
+		int delta(char const *previous);
+
+		int size();      /* report size of config by part and token type */
+		int dump();      /* dump raw XKB keymap */
+		int info();      /* simple per-key information */
+		int verify();    /* compare generated config with XKB */
+};
+
+
+/*
+ * Catalogue of the chargen configs of many layouts
+ *
+ * Maps and sequence tables shared by the layouts are stored once with
+ * per-layout overlays of the differences (see bundle.h for the format).
+ */
+class Xkb2ifcfg::Bundle
+{
+	public:
+
+		struct Layouts;
+
+	private:
+
+		Sink    &_diag;
+		Layouts *_layouts;
+
+		Bundle(Bundle const &) = delete;
+		Bundle & operator = (Bundle const &) = delete;
+
+	public:
+
+		struct Too_large      { };
+		struct Invalid_bundle { };
+
+		Bundle(Sink &diag);
+
+		~Bundle();
+
+		/*
+		 * Generate config of layout and add it to the bundle
+		 *
+		 * \throw exceptions of the Generator constructor
+		 * \return result of Generator::generate()
+		 */
+		int add(Config const &config);
+
+		/*
+		 * Add existing chargen config of layout 'name' to the bundle
+		 *
+		 * \throw Invalid_config
+		 */
+		void add(char const *name, char const *config);
+
+		/*
+		 * Write archive to 'output' and report sizes on 'diag'
+		 *
+		 * \throw  Too_large  too many distinct characters in configs
+		 * \return 0 on success, 1 if the archive does not reproduce all
+		 *         configs
+		 */
+		int write(Sink &output);
+
+		/*
+		 * Read archive back
+		 *
+		 * Writes the chargen config of 'layout' to 'output' or, if 'layout'
+		 * is nullptr, the names of all layouts in the archive.
+		 *
+		 * \throw  Invalid_bundle  'data' is not a valid archive
+		 * \return 0 on success, 1 if the layout is not in the archive
+		 */
+		static int extract(void const *data, size_t size, char const *layout,
+		                   Sink &output, Sink &diag);
+};
+
+#endif /* _XKB2IFCFG_H_ */
@@ -29,6 +29,8 @@
 
 /* Linux includes */
 #include <xkbcommon/xkbcommon.h>
+#include <array>
+#include <cstring>
 
 /* Genode includes */
 #include <input/keycodes.h>
@@ -44,18 +46,31 @@ namespace Xkb {
 		return xkb_keycode_t(unsigned(code) + 8);
 	}
 
+	/*
+	 * Keyboard models (bit mask of models providing a key)
+	 */
+	enum Models : unsigned {
+		PC104      = 1 << 0,
+		PC105      = 1 << 1,
+		JP106      = 1 << 2,
+		ABNT2      = 1 << 3,
+		KINESIS    = 1 << 4,
+		ALL_MODELS = PC104 | PC105 | JP106 | ABNT2 | KINESIS,
+	};
+
 	/*
 	 * Lookup table for keys eventually generating characters
 	 */
 	struct Mapping
 	{
-		xkb_keycode_t  xkb;
-		char const     xkb_name[7];
-		Input::Keycode code;
-		char const     ascii { 0 }; /* predefined non-printable */
+		xkb_keycode_t  xkb         { 0 };
+		char           xkb_name[7] { };
+		Input::Keycode code        { Input::KEY_RESERVED };
+		char           ascii       { 0 };          /* predefined non-printable */
+		unsigned       models      { ALL_MODELS };
 	};
 
-	Mapping printable[] = {
+	inline constexpr Mapping printable[] = {
 		{ 10,  "<AE01>", Input::KEY_1 },
 		{ 11,  "<AE02>", Input::KEY_2 },
 		{ 12,  "<AE03>", Input::KEY_3 },
@@ -109,7 +124,9 @@ namespace Xkb {
 		{ 61,  "<AB10>", Input::KEY_SLASH },
 
 		{ 65,  "<SPCE>", Input::KEY_SPACE },
-		{ 94,  "<LSGT>", Input::KEY_102ND }, /* right of <LFSH> (pc105) */
+		{ 94,  "<LSGT>", Input::KEY_102ND, 0, PC105 | ABNT2 }, /* right of <LFSH> (pc105) */
+		{ 97,  "<AB11>", Input::KEY_RO,    0, JP106 | ABNT2 }, /* left of <RTSH> */
+		{ 132, "<AE13>", Input::KEY_YEN,   0, JP106 },         /* left of <BKSP> */
 
 		{ 63,  "<KPMU>", Input::KEY_KPASTERISK },
 		{ 79,  "<KP7>",  Input::KEY_KP7 },
@@ -126,9 +143,79 @@ namespace Xkb {
 		{ 90,  "<KP0>",  Input::KEY_KP0 },
 		{ 91,  "<KPDL>", Input::KEY_KPDOT },
 		{ 106, "<KPDV>", Input::KEY_KPSLASH },
+		{ 129, "<KPPT>", Input::KEY_KPCOMMA, 0, ABNT2 },
+	};
+
+	/*
+	 * Printable keys of one keyboard model
+	 */
+	struct Keys
+	{
+		Mapping const *table;
+		unsigned       count;
+
+		Mapping const *begin() const { return table; }
+		Mapping const *end()   const { return table + count; }
+
+		unsigned size() const { return count; }
+
+		Mapping const & operator [] (unsigned i) const { return table[i]; }
 	};
 
-	Mapping non_printable[] = {
+	template <unsigned MODEL>
+	constexpr unsigned num_printable()
+	{
+		unsigned n = 0;
+		for (Mapping const &m : printable)
+			if (m.models & MODEL) ++n;
+		return n;
+	}
+
+	/*
+	 * Compile-time table of the printable keys of MODEL
+	 */
+	template <unsigned MODEL>
+	struct Model_printable
+	{
+		static constexpr std::array<Mapping, num_printable<MODEL>()> _table()
+		{
+			std::array<Mapping, num_printable<MODEL>()> result { };
+
+			unsigned i = 0;
+			for (Mapping const &m : printable)
+				if (m.models & MODEL) result[i++] = m;
+
+			return result;
+		}
+
+		static constexpr std::array<Mapping, num_printable<MODEL>()> table = _table();
+
+		static Keys keys() { return Keys { table.data(), unsigned(table.size()) }; }
+	};
+
+	struct Model
+	{
+		char const *name;   /* XKB model name */
+		Keys        printable;
+	};
+
+	inline Model const model[] = {
+		{ "pc104",   Model_printable<PC104>::keys()   },
+		{ "pc105",   Model_printable<PC105>::keys()   },
+		{ "jp106",   Model_printable<JP106>::keys()   },
+		{ "abnt2",   Model_printable<ABNT2>::keys()   },
+		{ "kinesis", Model_printable<KINESIS>::keys() },
+	};
+
+	inline Model const * lookup_model(char const *name)
+	{
+		for (Model const &m : model)
+			if (!::strcmp(m.name, name)) return &m;
+
+		return nullptr;
+	}
+
+	inline Mapping const non_printable[] = {
 		{ 9,   "<ESC>",  Input::KEY_ESC,       27 },
 		{ 22,  "<BKSP>", Input::KEY_BACKSPACE, 8 },
 		{ 23,  "<TAB>",  Input::KEY_TAB,       9 },
@@ -137,11 +224,41 @@ namespace Xkb {
 		{ 119, "<DELE>", Input::KEY_DELETE,    127 },
 	};
 
+	/*
+	 * Modifiers of the generated chargen maps
+	 *
+	 * Each modifier corresponds to a 'mod' attribute of the input_filter
+	 * chargen and is emulated on generation by holding the key pressed or
+	 * by tapping it (press and release), which locks or latches the
+	 * modifier depending on the key action in the keymap. Maps are
+	 * generated for all combinations of modifiers. input_filter chargen
+	 * supports four modifiers (mod1-mod4) only.
+	 */
+	struct Modifier
+	{
+		enum class Emulation { PRESSED, TAPPED };
+
+		char const     *name;
+		char const     *attr;
+		Input::Keycode  code;
+		Emulation       emulation;
+		bool            control;
+	};
+
+	inline Modifier const modifier[] = {
+		{ "SHIFT",    "mod1", Input::KEY_LEFTSHIFT, Modifier::Emulation::PRESSED, false },
+		{ "CONTROL",  "mod2", Input::KEY_LEFTCTRL,  Modifier::Emulation::PRESSED, true  },
+		{ "ALTGR",    "mod3", Input::KEY_RIGHTALT,  Modifier::Emulation::PRESSED, false },
+		{ "CAPSLOCK", "mod4", Input::KEY_CAPSLOCK,  Modifier::Emulation::TAPPED,  false },
+	};
+
 	struct Dead_keysym
 	{
 		xkb_keysym_t xkb;
 		unsigned     utf32;
-	} dead_keysym[] = {
+	};
+
+	inline Dead_keysym const dead_keysym[] = {
 		{ XKB_KEY_dead_grave,              0x0300 },
 		{ XKB_KEY_dead_acute,              0x0301 },
 		{ XKB_KEY_dead_circumflex,         0x0302 },
@@ -0,0 +1,81 @@
+/*
+ * \brief  Growing buffer for Xml_generator output
+ * \author Christian Helmuth <christian.helmuth@genode-labs.com>
+ * \date   2019-07-16
+ *
+ * Copyright (C) 2019 Genode Labs GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _XML_BUFFER_H_
+#define _XML_BUFFER_H_
+
+/* Linux includes */
+#include <cstdlib>
+
+/* Genode includes */
+#include <util/xml_generator.h>
+#include <util/retry.h>
+
+
+/*
+ * XML generator that expands to your needs
+ */
+class Expanding_xml_buffer
+{
+	private:
+
+		char const *_name;
+
+		enum { BUFFER_INCREMENT = 1024*1024 };
+
+		size_t  _buffer_size { 0 };
+		char   *_buffer      { nullptr };
+
+		void _increase_buffer()
+		{
+			::free(_buffer);
+
+			_buffer_size += BUFFER_INCREMENT;
+			_buffer       = (char *)::calloc(1, _buffer_size);
+		}
+
+	public:
+
+		Expanding_xml_buffer() { _increase_buffer(); }
+
+		~Expanding_xml_buffer() { ::free(_buffer); }
+
+		char const *buffer() const { return _buffer; }
+
+		template <typename FUNC>
+		void generate(char const *name, FUNC const &func)
+		{
+			Genode::retry<Genode::Xml_generator::Buffer_exceeded>(
+				[&] () {
+					Genode::Xml_generator xml(_buffer, _buffer_size,
+					                          name, [&] () { func(xml); });
+				},
+				[&] () { _increase_buffer(); }
+			);
+		}
+};
+
+#endif /* _XML_BUFFER_H_ */